@@ -17,23 +17,386 @@
 #define _DHT22_H
 
 #define DEFAULT_GPIO            4
+#define DHT22_SENSORS_MAX       32          /* max. entries of 'gpios' */
+#define DHT22_HISTORY_LEN       256         /* records kept per sensor */
 #define DEFAULT_AUTOUPDATE_SEC  10          /* re-trigger DHT22 after 10 sec */
 #define AUTOUPDATE_SEC_MIN      3           /* 3 seconds */
 #define AUTOUPDATE_SEC_MAX      60000       /* 10 min */
+#define SLACK_US_MAX            1000000     /* timer slack of autoupdate */
+#define DEFAULT_ADAPTIVE_MIN_SEC    3       /* adaptive autoupdate */
+#define DEFAULT_ADAPTIVE_MAX_SEC    120
+#define DEFAULT_ADAPTIVE_RATE_H     10      /* 1 %RH per minute */
+#define DEFAULT_ADAPTIVE_RATE_T     5       /* 0.5 °C per minute */
+
+#define DHT22_MIN_INTERVAL_SEC  2           /* between two conversions */
+#define DEFAULT_RETRIES         3           /* retries of a failed read */
+#define DHT22_RETRIES_MAX       5
+#define DHT22_RETRY_MAX_SEC     16          /* backoff 2, 4, 8, 16, 16 sec */
+
+#define DHT22_START_PULSE_NS    1000000     /* host start pulse, 1ms */
+#define DHT22_POLL_WINDOW_NS    5500000     /* polled capture, after start */
+#define DHT22_HIST_BUCKETS      32
+#define DHT22_HIST_HIGH_STEP_NS 4000        /* 4us buckets, HIGH pulses */
+
+#define DEFAULT_HEARTBEAT_SEC   600         /* notify at least every 10 min */
+#define DEADBAND_MAX            1000        /* 100 %RH or 100 °C */
+
+#define DHT22_STATS_BUCKETS     60          /* slices of a rolling window */
+#define STATS_WINDOW_SEC_MIN    60          /* 1 min */
+#define STATS_WINDOW_SEC_MAX    604800      /* 7 days */
+#define DEFAULT_NETLINK_BATCH_MS 100        /* readings per datagram */
+#define NETLINK_BATCH_MS_MAX    1000
+#define DEFAULT_EWMA_ALPHA      100         /* per mille, 0.1 */
+#define DHT22_EWMA_SHIFT        16          /* fraction bits of the EWMA */
 
 #define IO_BUF_MAX          64
+#define DHT22_TEXT_MAX      24          /* "-3276.8 -3276.8\n" and the like */
 
 /*
  * proprietary to dht22.c, not seen by others
  */
 #ifdef _INCLUDE_DHT22_DECL
 
+#include "dht22_user.h"
+#include "dht22_decode.h"
+
+/*
+ * device nodes of each sensor <n>,
+ * minor number is <n> * DHT22_DEVS_PER_SENSOR + kind
+ */
+enum dht22_dev_kind {
+    DHT22_DEV_HUMIDITY,             /* /dev/dht22:<2n>          */
+    DHT22_DEV_TEMPERATURE,          /* /dev/dht22:<2n+1>        */
+    DHT22_DEV_HISTORY,              /* /dev/dht22_history:<n>   */
+    DHT22_DEV_READING,              /* /dev/dht22_reading:<n>   */
+    DHT22_DEVS_PER_SENSOR
+};
+
+/*
+ * text forms of the latest reading, rendered once per conversion,
+ * see render_texts()
+ */
+enum dht22_text {
+    DHT22_TEXT_HUMIDITY,            /* "81.5\n", /dev/dht22:<2n>         */
+    DHT22_TEXT_TEMPERATURE,         /* "26.5\n", /dev/dht22:<2n+1>       */
+    DHT22_TEXT_READING,             /* "81.5 26.5\n", sysfs 'reading' and
+                                       /dev/dht22_reading:<n>           */
+    DHT22_TEXT_SYSFS_HUMIDITY,      /* "81.5%\n", sysfs 'humidity'       */
+    DHT22_TEXT_SYSFS_TEMPERATURE,   /* "26.5°C\n", sysfs 'temperature'   */
+    DHT22_TEXTS
+};
+
+struct dht22_texts {
+    u8          len [DHT22_TEXTS];
+    char        text[DHT22_TEXTS][DHT22_TEXT_MAX];
+};
+
+/*
+ * how the edges of a transaction are captured, module parameter 'capture'
+ */
+enum dht22_capture {
+    DHT22_CAPTURE_IRQ,              /* one interrupt per edge           */
+    DHT22_CAPTURE_POLL,             /* busy sampling, interrupts off    */
+    DHT22_CAPTURES
+};
+
+/*
+ * when autoupdate triggers, module parameter 'schedule'
+ */
+enum dht22_schedule {
+    DHT22_SCHEDULE_RELATIVE,        /* autoupdate_sec after the previous  */
+    DHT22_SCHEDULE_MONOTONIC,       /* multiples of autoupdate_sec of     */
+    DHT22_SCHEDULE_REALTIME,        /* CLOCK_MONOTONIC/REALTIME + phase   */
+    DHT22_SCHEDULES
+};
+
+/*
+ * transaction state of a sensor, see trigger_dht22()
+ */
+enum dht22_state {
+    dht22_idle,
+    dht22_start,                    /* host pulls the bus LOW           */
+    dht22_response,                 /* bus released, wait for DHT22     */
+    dht22_data,                     /* receiving 40 bits                */
+    dht22_done                      /* frame queued to process_results() */
+};
+
+/*
+ * histogram of durations for debugfs, updated from any context;
+ * bucket i is [i * step_ns, (i + 1) * step_ns), or [2^i, 2^(i+1)) ns
+ * if step_ns is 0; the last bucket also counts anything longer
+ */
+struct dht22_hist {
+    u32         step_ns;
+    atomic_t    count[DHT22_HIST_BUCKETS];
+};
+
+/*
+ * sum of samples of one quantity, in 0.1 units
+ */
+struct dht22_stat_acc {
+    s32         min;
+    s32         max;
+    s64         sum;
+    u64         sumsq;
+};
+
+/*
+ * one slice of a rolling window, the samples of one bucket_ns period;
+ * 'epoch' is the number of that period since boot, a bucket left over
+ * from an older one is cleared when reused.
+ * acc[0] is humidity, acc[1] temperature
+ */
+struct dht22_stat_bucket {
+    u64                     epoch;
+    u32                     count;
+    struct dht22_stat_acc   acc[2];
+};
+
+struct dht22_window {
+    u32                         window_sec;
+    u64                         bucket_ns;
+    struct dht22_stat_bucket    bucket[DHT22_STATS_BUCKETS];
+};
+
+/*
+ * per-sensor context, one for each GPIO listed in 'gpios'
+ * the embedded kobject owns the memory (freed by its release function)
+ */
+struct dht22_sensor {
+    int                 id;             /* index in 'gpios' */
+    int                 gpio;
+    int                 irq_number;
+    bool                dying;          /* being removed, nothing re-arms */
+    bool                autoupdate;
+    int                 autoupdate_sec;
+    /*
+     * schedule of autoupdate_timer, see autoupdate_next();
+     * autoupdate_lock serializes reprogramming it from sysfs
+     */
+    int                 schedule;
+    int                 phase_ms;
+    int                 slack_us;
+    struct mutex        autoupdate_lock;
+    /*
+     * adaptive autoupdate, see adaptive_update(): interval_sec between
+     * adaptive_sec[0] and [1] instead of autoupdate_sec; adaptive_rate[]
+     * is in 0.1 units per minute, [0] humidity
+     */
+    bool                adaptive;
+    int                 adaptive_sec[2];
+    int                 adaptive_rate[2];
+    int                 interval_sec;
+    /*
+     * autoupdate pauses after idle_sec without any consumer: no open
+     * /dev/dht22* (mmap() keeps it open) or enabled IIO buffer, and no
+     * read of a value in sysfs since 'last_active' (jiffies);
+     * see autoupdate_idle() and consumer_seen()
+     */
+    int                 idle_sec;       /* 0 never pauses */
+    atomic_t            consumers;
+    unsigned long       last_active;
+    bool                paused;         /* autoupdate_timer stopped */
+    /*
+     * latest reading; humidity/temperature/timestamp of the last good
+     * conversion, seq bumped on each of them, status of the last conversion;
+     * 'texts' is it rendered for read() and sysfs, which only copy it.
+     * process_results() is the only writer, readers never take a lock,
+     * see get_reading() and get_text()
+     */
+    seqcount_t          reading_seqcount;
+    struct dht22_record reading;
+    struct dht22_texts  texts;
+    /*
+     * notifications of the latest reading (sysfs_notify() and 'wait'),
+     * only if it moved by deadband[] or more since 'notified' or after
+     * heartbeat_sec of silence; 'notified' is the last reading notified,
+     * also under reading_seqcount. deadband[0] is humidity, in 0.1 units
+     */
+    int                 deadband[2];
+    int                 heartbeat_sec;  /* 0 to disable */
+    struct dht22_record notified;
+    wait_queue_head_t   wait;           /* woken for notified readings */
+    wait_queue_head_t   history_wait;   /* woken for each history record */
+    /*
+     * reads of a fresh reading, see read_fresh(); done_count counts
+     * finished transactions, good or not, fresh_timer defers a conversion
+     * until DHT22_MIN_INTERVAL_SEC after the previous one
+     */
+    int                 max_age_ms;     /* default of new files */
+    atomic_t            done_count;
+    wait_queue_head_t   done_wait;
+    struct hrtimer      fresh_timer;
+    /*
+     * ring of the last DHT22_HISTORY_LEN conversions;
+     * record of sequence number 'seq' is at history[seq % DHT22_HISTORY_LEN]
+     */
+    spinlock_t          history_lock;
+    u64                 history_seq;    /* seq of next record */
+    struct dht22_record history[DHT22_HISTORY_LEN];
+    struct dht22_shm*   shm;            /* page shared by mmap() */
+    /*
+     * rolling statistics of good readings, updated by process_results()
+     * and reconfigured via sysfs under stats_lock; the summary 'stats' is
+     * published with a seqcount, readers never take the lock.
+     * ewma[] is in 0.1 units << DHT22_EWMA_SHIFT, [0] humidity
+     */
+    struct mutex        stats_lock;
+    struct dht22_window windows[DHT22_STATS_WINDOWS];
+    int                 ewma_alpha;     /* per mille */
+    s64                 ewma[2];
+    seqcount_t          stats_seqcount;
+    struct dht22_stats  stats;
+    struct hrtimer      autoupdate_timer;
+    struct hrtimer      timeout_timer;
+    /*
+     * retry of a failed conversion, after 2 << (retry_level - 1) sec;
+     * retry_level 0 is the regular trigger, index of the counters
+     */
+    struct hrtimer      retry_timer;
+    int                 retries;        /* max. retries, 0 to disable */
+    int                 retry_level;
+    u32                 retry_attempts [DHT22_RETRIES_MAX + 1];
+    u32                 retry_successes[DHT22_RETRIES_MAX + 1];
+    struct work_struct  process_work;
+    /*
+     * capture engine; 'capture' is selected via sysfs, 'capture_mode' is
+     * the one of the transaction in progress, index of the counters.
+     * capture_cpu_ns is CPU time spent capturing: in IRQ mode, pulling
+     * the bus LOW and the IRQ handlers (the start pulse itself is timed
+     * by start_timer); in polled mode, the whole polling window
+     */
+    int                 capture;
+    int                 capture_mode;
+    struct work_struct  capture_work;   /* DHT22_CAPTURE_POLL */
+    u32                 capture_reads    [DHT22_CAPTURES];
+    u32                 capture_successes[DHT22_CAPTURES];
+    u64                 capture_cpu_ns   [DHT22_CAPTURES];
+    /*
+     * edge log of the transaction in progress, filled by the IRQ handler
+     * or poll_capture();
+     * DHT22 sends out 2-byte humidity, 2-byte temperature and 1-byte CRC,
+     * each bit is a ~50us LOW followed by 22~30us HIGH (0) or 68~75us (1)
+     */
+    u64                 trigger_ns;     /* start pulse, CLOCK_MONOTONIC */
+    u64                 prev_edge_ns;
+    int                 edge_count;
+    struct dht22_edge   edges[DHT22_EDGES_MAX];
+    enum dht22_state    state;          /* see trigger_dht22() */
+    struct hrtimer      start_timer;    /* end of the start pulse */
+    struct kobject      kobj;           /* /sys/kernel/dht22/sensor<id> */
+    /*
+     * copy of the edge log of the last decoded transaction,
+     * for /sys/kernel/debug/dht22/sensor<id>/edges
+     */
+    struct mutex        last_edges_lock;
+    int                 last_edge_count;
+    u64                 last_edges_ns;  /* when the start pulse ended */
+    struct dht22_edge   last_edges[DHT22_EDGES_MAX];
+    struct dentry*      debugfs;
+    /*
+     * IIO device "dht22" and its trigger, fired on each new reading;
+     * NULL if IIO isn't available
+     */
+    struct iio_dev*     iio;
+    struct iio_trigger* iio_trig;
+    /*
+     * statistics under /sys/kernel/debug/dht22/sensor<id>
+     * failures by cause: no response, edges lost beyond repair,
+     * checksum mismatch and trigger ignored while busy
+     */
+    atomic_t            fail_timeout;
+    atomic_t            fail_edges;
+    atomic_t            fail_crc;
+    atomic_t            fail_busy;
+    u64                 queued_ns;      /* process_work queued */
+    struct dht22_hist   hist_irq;       /* dht22_irq_handler() duration */
+    struct dht22_hist   hist_latency;   /* start pulse to result */
+    struct dht22_hist   hist_wq_delay;  /* process_work queued to run */
+    struct dht22_hist   hist_high;      /* HIGH pulses of clean frames */
+    /*
+     * the following will be printed if dbg_flag is true
+     */
+    int                 dbg_fail_read;
+    int                 dbg_total_read;
+};
+
+#define to_dht22_sensor(k) container_of(k, struct dht22_sensor, kobj)
+
+/*
+ * per-open state of /dev/dht22*, file->private_data
+ */
+struct dht22_file {
+    struct dht22_sensor*    sensor;
+    u64                     seen;       /* last reading_seq returned */
+    int                     mode;       /* DHT22_MODE_TEXT/BINARY */
+    int                     max_age_ms; /* 0 never waits */
+};
+
+static int  dht22_sensor_init(int id, int gpio);
+static void dht22_sensor_exit(struct dht22_sensor* sensor);
+static void dht22_kobj_release(struct kobject* kobj);
 static void process_results(struct work_struct* work);
+static int  dht22_debugfs_init(struct dht22_sensor* sensor);
+static int  dht22_iio_init(struct dht22_sensor* sensor);
+static void dht22_iio_unregister(struct dht22_sensor* sensor);
+static void dht22_iio_exit(struct dht22_sensor* sensor);
+static void dht22_iio_push(struct dht22_sensor* sensor);
+static int  dht22_genl_init(void);
+static void dht22_genl_exit(void);
+static void dht22_genl_send(struct dht22_sensor* sensor,
+                            const struct dht22_record* reading);
+static bool dht22_genl_listening(void);
+static int  edges_open(struct inode*, struct file*);
+static int  edges_show(struct seq_file*, void*);
+static int  hist_open(struct inode*, struct file*);
+static int  hist_show(struct seq_file*, void*);
+static void hist_add(struct dht22_hist* hist, u64 ns);
+static void queue_results(struct dht22_sensor* sensor, u64 now);
+static void hist_add_high(struct dht22_sensor* sensor, int count);
+static void history_add(struct dht22_sensor* sensor, u64 timestamp_ns,
+                        int humidity, int temperature, u32 status);
+static void publish_reading(struct dht22_sensor* sensor,
+                            const struct dht22_record* reading, bool notify);
+static bool notify_due(struct dht22_sensor* sensor,
+                       const struct dht22_record* reading);
+static void shm_publish(struct dht22_sensor* sensor, u64 timestamp_ns,
+                        int humidity, int temperature);
+static void stats_init(struct dht22_sensor* sensor);
+static void stats_add(struct dht22_sensor* sensor, u64 timestamp_ns,
+                      int humidity, int temperature);
+static void stats_publish(struct dht22_sensor* sensor, u64 timestamp_ns,
+                          u64 count);
+static void stat_summary(struct dht22_stat* stat,
+                         const struct dht22_stat_acc* acc, u32 count);
+static void get_stats(struct dht22_sensor*, struct dht22_stats*);
+static void get_reading(struct dht22_sensor*, struct dht22_record*);
+static u64  get_reading_seq(struct dht22_sensor*);
+static u64  get_notified_seq(struct dht22_sensor*);
+static int  get_text(struct dht22_sensor*, enum dht22_text, char*, u64*);
+static void render_texts(struct dht22_texts* texts,
+                         const struct dht22_record* reading);
+static int  sprint_tenths(char* buf, int data);
 static irqreturn_t dht22_irq_handler(int irq, void* data); 
 static enum hrtimer_restart autoupdate_func(struct hrtimer *hrtimer);
+static ktime_t autoupdate_next(struct dht22_sensor* sensor);
+static int  autoupdate_period(struct dht22_sensor* sensor);
+static bool autoupdate_idle(struct dht22_sensor* sensor);
+static void consumer_get(struct dht22_sensor* sensor);
+static void consumer_put(struct dht22_sensor* sensor);
+static void consumer_seen(struct dht22_sensor* sensor);
+static void adaptive_update(struct dht22_sensor* sensor,
+                            const struct dht22_record* prev,
+                            const struct dht22_record* reading);
+static void autoupdate_restart(struct dht22_sensor* sensor);
 static enum hrtimer_restart timeout_func(struct hrtimer* hrtimer);
-static void to_trigger_dht22(void);
-static void trigger_dht22(void);
+static enum hrtimer_restart retry_func(struct hrtimer* hrtimer);
+static enum hrtimer_restart start_func(struct hrtimer* hrtimer);
+static enum hrtimer_restart fresh_func(struct hrtimer* hrtimer);
+static void schedule_retry(struct dht22_sensor* sensor);
+static void to_trigger_dht22(struct dht22_sensor* sensor, int retry_level);
+static void trigger_dht22(struct dht22_sensor* sensor);
+static void poll_capture(struct work_struct* work);
 static void dht22_timer_init(struct hrtimer*, 
                              enum hrtimer_restart (*)(struct hrtimer*),
                              bool,
@@ -49,8 +412,22 @@ static ssize_t  dev_read_h(struct file*, char __user*, size_t, loff_t*);
 /* temperature fops */
 static int      dev_open_t(struct inode*, struct file*);
 static ssize_t  dev_read_t(struct file*, char __user*, size_t, loff_t*);
-static ssize_t  read_data(struct file*, char __user*, size_t, loff_t*, int,
-                          int factor);
+/* humidity + temperature fops */
+static int      dev_open_r(struct inode*, struct file*);
+static ssize_t  dev_read_r(struct file*, char __user*, size_t, loff_t*);
+static ssize_t  read_data(struct file*, char __user*, size_t, loff_t*,
+                          enum dht22_dev_kind);
+static ssize_t  read_record(char __user*, size_t, const struct dht22_record*);
+static int      read_fresh(struct file*);
+static void     request_conversion(struct dht22_sensor* sensor);
+static void     transaction_done(struct dht22_sensor* sensor);
+static long     dev_ioctl(struct file*, unsigned int, unsigned long);
+static int      dev_mmap(struct file*, struct vm_area_struct*);
+static unsigned int dev_poll(struct file*, poll_table*);
+/* history fops */
+static ssize_t  dev_read_history(struct file*, char __user*, size_t, loff_t*);
+static loff_t   dev_llseek_history(struct file*, loff_t, int);
+static unsigned int dev_poll_history(struct file*, poll_table*);
 
 #define ATTR_RW(v) struct kobj_attribute v ## _attr = __ATTR_RW(v)
 #define ATTR_RO(v) struct kobj_attribute v ## _attr = __ATTR_RO(v)
@@ -70,9 +447,44 @@ static DECL_ATTR_SHOW (autoupdate);
 static DECL_ATTR_STORE(autoupdate);
 static DECL_ATTR_SHOW (autoupdate_sec);
 static DECL_ATTR_STORE(autoupdate_sec);
+static DECL_ATTR_SHOW (schedule);
+static DECL_ATTR_STORE(schedule);
+static DECL_ATTR_SHOW (phase_ms);
+static DECL_ATTR_STORE(phase_ms);
+static DECL_ATTR_SHOW (slack_us);
+static DECL_ATTR_STORE(slack_us);
+static DECL_ATTR_SHOW (adaptive);
+static DECL_ATTR_STORE(adaptive);
+static DECL_ATTR_SHOW (adaptive_sec);
+static DECL_ATTR_STORE(adaptive_sec);
+static DECL_ATTR_SHOW (adaptive_rate);
+static DECL_ATTR_STORE(adaptive_rate);
+static DECL_ATTR_SHOW (interval_sec);
+static DECL_ATTR_SHOW (idle_sec);
+static DECL_ATTR_STORE(idle_sec);
+static DECL_ATTR_SHOW (consumers);
 static DECL_ATTR_SHOW (humidity);
 static DECL_ATTR_SHOW (temperature);
+static DECL_ATTR_SHOW (reading);
 static DECL_ATTR_STORE(trigger);
+static DECL_ATTR_SHOW (max_age_ms);
+static DECL_ATTR_STORE(max_age_ms);
+static DECL_ATTR_SHOW (retries);
+static DECL_ATTR_STORE(retries);
+static DECL_ATTR_SHOW (retry_stats);
+static DECL_ATTR_SHOW (capture);
+static DECL_ATTR_STORE(capture);
+static DECL_ATTR_SHOW (capture_stats);
+static DECL_ATTR_SHOW (deadband);
+static DECL_ATTR_STORE(deadband);
+static DECL_ATTR_SHOW (heartbeat_sec);
+static DECL_ATTR_STORE(heartbeat_sec);
+static DECL_ATTR_SHOW (stats);
+static DECL_ATTR_SHOW (stats_windows);
+static DECL_ATTR_STORE(stats_windows);
+static DECL_ATTR_SHOW (ewma);
+static DECL_ATTR_SHOW (ewma_alpha);
+static DECL_ATTR_STORE(ewma_alpha);
 static DECL_ATTR_STORE(debug);
 
 #endif /* _INCLUDE_DHT22_DECL */
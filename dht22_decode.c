@@ -0,0 +1,398 @@
+/*
+ * DHT22 Humidity And Temperature Sensor Driver, edge log decoder
+ * 
+ * Copyright (c) Edward Lin <edwardlin.tw@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ */
+#ifdef __KERNEL__
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/errno.h>
+#else
+#include <string.h>
+#include <errno.h>
+#endif
+#include "dht22_decode.h"
+
+/*
+ * index of the first edge of data bits, after host's start pulse
+ * (if logged) and DHT22's ~80us LOW + ~80us HIGH response; -1 if not found
+ */
+int dht22_find_data_start(const struct dht22_edge* edges, int count)
+{
+    int i = 0;
+    int j;
+
+    for (j = 0; j < count && j < 4; ++j) {
+        if (edges[j].delta_ns >= DHT22_START_MIN_NS)
+            i = j + 1;
+    }
+
+    for (; i + 1 < count && i < 8; ++i) {
+        u32 lo = edges[i].delta_ns;
+        u32 hi = edges[i + 1].delta_ns;
+
+        if (lo >= DHT22_RESPONSE_MIN_NS && lo <= DHT22_RESPONSE_MAX_NS &&
+            hi >= DHT22_RESPONSE_MIN_NS && hi <= DHT22_RESPONSE_MAX_NS)
+            return i + 2;
+
+        /* rising edge of the response lost, LOW and HIGH in one */
+        if (0 == edges[i].level &&
+            lo >= 2 * DHT22_RESPONSE_MIN_NS && lo <= 2 * DHT22_RESPONSE_MAX_NS)
+            return i + 1;
+    }
+
+    return -1;
+}
+
+/*
+ * nominal time of pulses p ~ p+n-1 of the data bits,
+ * even pulses are LOW, odd pulses are HIGH of bit p/2
+ */
+static u32 pulses_ns(int p, int n, u32 low_ns, u32 high_ns)
+{
+    u32 sum = 0;
+
+    for (; n > 0; --n, ++p)
+        sum += (p & 1) ? high_ns : low_ns;
+    return sum;
+}
+
+/*
+ * most pulses one edge can stand for from pulse p on: high[] has room for
+ * two HIGHs in one edge only, so LOW HIGH LOW HIGH or HIGH LOW HIGH
+ */
+static int max_merge(int p)
+{
+    return (p & 1) ? 3 : 4;
+}
+
+/*
+ * realign edges to pulses from edges[start] on: high[] gets the HIGH time
+ * of each bit, pair[] marks a bit sharing its HIGH edge with the next one.
+ * an edge whose length is too close to the limit between n and n+2 pulses
+ * is a guess, counted in *guesses; guess k is taken the other way if bit k
+ * of 'flip' is set.
+ * returns the number of pulses found, -1 if an edge is too long for any
+ * number of them or edges are left over, both a wrong alignment
+ */
+static int realign(const struct dht22_edge* edges, int start, int count,
+                   u32 low_ns, int flip, u32 high[DHT22_BITS],
+                   u8 pair[DHT22_BITS], int* guesses, int* repaired)
+{
+    u32 carry = 0;
+    int left = 0;
+    int p = 0;
+    int j;
+
+    memset(high, 0, sizeof(high[0]) * DHT22_BITS);
+    memset(pair, 0, sizeof(pair[0]) * DHT22_BITS);
+    *guesses  = 0;
+    *repaired = 0;
+
+    for (j = start; j < count && p < DHT22_PULSES; ++j) {
+        u32 d   = edges[j].delta_ns + carry;
+        int n   = (edges[j].level == !(p & 1)) ? 1 : 2;
+        int max = max_merge(p);
+        u32 lows;
+        int b;
+
+        /* duplicate edge, its time belongs to the pulse it split */
+        if (edges[j].delta_ns < DHT22_GLITCH_NS) {
+            carry = d;
+            ++*repaired;
+            continue;
+        }
+        carry = 0;
+
+        /* too short for two pulses, the level was misread */
+        if (2 == n && d < low_ns)
+            n = 1;
+        /* longer than n pulses can be, two more edges lost */
+        while (n + 2 <= max) {
+            u32 mid  = (pulses_ns(p, n, low_ns, DHT22_HIGH1_NS) +
+                        pulses_ns(p, n + 2, low_ns, DHT22_HIGH0_NS)) / 2;
+            int more = d > mid;
+
+            if ((more ? d - mid : mid - d) < DHT22_REALIGN_NS) {
+                if (*guesses < 31 && (flip & (1 << *guesses)))
+                    more = !more;
+                ++*guesses;
+            }
+            if (!more)
+                break;
+            n += 2;
+        }
+        /*
+         * longer than n pulses by a whole LOW, more edges lost than
+         * max_merge() pulses can tell apart
+         */
+        if (d > pulses_ns(p, n, low_ns, DHT22_HIGH1_NS) + low_ns)
+            return -1;
+        if (n > 1)
+            ++*repaired;
+
+        lows = pulses_ns(p, n, low_ns, 0);
+        b    = p / 2;           /* first bit whose HIGH is in this edge */
+        if (b < DHT22_BITS && p + n > 2 * b + 1) {
+            high[b] = d > lows ? d - lows : 0;
+            /* two HIGHs in one edge, only their sum is known */
+            if (p + n > 2 * b + 3 && b + 1 < DHT22_BITS)
+                pair[b] = 1;
+        }
+        p += n;
+    }
+
+    /* edges left over but the final one, pulses taken as one too many */
+    for (; j < count; ++j) {
+        if (edges[j].delta_ns >= DHT22_GLITCH_NS && ++left > 1)
+            return -1;
+    }
+    return p;
+}
+
+/*
+ * bit values of one alignment: the most likely frame goes to likely[]
+ * (if not NULL), every candidate passing the checksum to good[], counted
+ * in *matches unless already there
+ * returns -EIO if more bits are in doubt than candidates can cover
+ */
+static int decide_bits(const u32 high[DHT22_BITS], const u8 pair[DHT22_BITS],
+                       int bits, u8 likely[5], u8 good[5], int* matches,
+                       struct dht22_decode_info* info)
+{
+    u8   bit[DHT22_BITS];
+    int  amb[DHT22_AMBIGUOUS_MAX];      /* first bit of ambiguous ones */
+    int  namb = 0;
+    u32  m0 = DHT22_HIGH0_NS;
+    u32  m1 = DHT22_HIGH1_NS;
+    u32  t;
+    u32  margin;
+    int  i;
+    int  j;
+    int  it;
+    int  mask;
+
+    /* adaptive threshold, 2-means on single HIGH times */
+    t = info->low_ns;
+    for (it = 0; it < 4; ++it) {
+        u32 s0 = 0, s1 = 0;
+        int n0 = 0, n1 = 0;
+
+        for (i = 0; i < bits; ++i) {
+            if (pair[i] || (i > 0 && pair[i - 1]))
+                continue;
+            if (high[i] > t) {
+                s1 += high[i];
+                ++n1;
+            }
+            else {
+                s0 += high[i];
+                ++n0;
+            }
+        }
+        if (0 == n0 || 0 == n1)
+            break;
+        m0 = s0 / n0;
+        m1 = s1 / n1;
+        t  = (m0 + m1) / 2;
+    }
+    if (likely)
+        info->threshold_ns = t;
+    margin = (m1 - m0) / 4;
+
+    /*
+     * most likely bits, and the ones worth a second guess;
+     * namb keeps counting past the room in amb[]
+     */
+    for (i = 0; i < DHT22_BITS; ++i) {
+        int doubt;
+
+        if (i >= bits) {
+            /* last HIGH not ended, either value */
+            bit[i] = 0;
+            doubt  = 1;
+        }
+        else if (pair[i]) {
+            u32 s    = high[i];
+            u32 d00  = s > 2 * m0 ? s - 2 * m0 : 2 * m0 - s;
+            u32 d01  = s > m0 + m1 ? s - (m0 + m1) : m0 + m1 - s;
+            u32 d11  = s > 2 * m1 ? s - 2 * m1 : 2 * m1 - s;
+
+            /* 01 or 10, ask the checksum */
+            doubt = d01 <= d00 && d01 <= d11;
+            if (doubt) {
+                bit[i]     = 0;
+                bit[i + 1] = 1;
+            }
+            else
+                bit[i] = bit[i + 1] = d11 < d00;
+        }
+        else {
+            u32 diff = high[i] > t ? high[i] - t : t - high[i];
+
+            bit[i] = high[i] > t;
+            doubt  = diff < margin;
+        }
+
+        if (doubt) {
+            if (namb < DHT22_AMBIGUOUS_MAX)
+                amb[namb] = i;
+            ++namb;
+        }
+        if (i < bits && pair[i])
+            ++i;
+    }
+
+    /* the rest would be decided blindly, don't trust the checksum */
+    if (namb > DHT22_AMBIGUOUS_MAX) {
+        if (likely) {
+            for (i = 0; i < DHT22_BITS; ++i)
+                likely[i >> 3] = (likely[i >> 3] << 1) | bit[i];
+        }
+        return -EIO;
+    }
+
+    /* candidates, mask 0 is the most likely one */
+    for (mask = 0; mask < (1 << namb) && *matches < 2; ++mask) {
+        u8 cand[5] = { 0 };
+
+        for (j = 0; j < namb; ++j) {
+            if (mask & (1 << j)) {
+                bit[amb[j]] ^= 1;
+                if (pair[amb[j]])
+                    bit[amb[j] + 1] ^= 1;
+            }
+        }
+        for (i = 0; i < DHT22_BITS; ++i)
+            cand[i >> 3] = (cand[i >> 3] << 1) | bit[i];
+        for (j = 0; j < namb; ++j) {
+            if (mask & (1 << j)) {
+                bit[amb[j]] ^= 1;
+                if (pair[amb[j]])
+                    bit[amb[j] + 1] ^= 1;
+            }
+        }
+
+        ++info->candidates;
+        if (0 == mask && likely)
+            memcpy(likely, cand, 5);
+        if (cand[4] == ((cand[0] + cand[1] + cand[2] + cand[3]) & 0xFF) &&
+            (0 == *matches || memcmp(good, cand, 5))) {
+            memcpy(good, cand, 5);
+            ++*matches;
+        }
+    }
+    return 0;
+}
+
+/*
+ * determine bit value 0 or 1 from the edge log
+ * DHT22 spec: ~50us LOW then 22-30us HIGH is 0, 68~75us HIGH is 1
+ *
+ * each logged edge ends one pulse, unless interrupts were lost (or
+ * duplicated); then an edge stands for several pulses:
+ *  - the level after the edge tells whether an even number of edges
+ *    were lost in between, the length tells how many pulses it covers;
+ *  - the HIGH time of a bit inside such an edge is its length minus
+ *    the LOW times, taken from the mean LOW time of this frame.
+ * rather than a fixed 50us, the threshold between bit 0 and 1 adapts to
+ * the frame: it starts at the mean LOW time and is refined by 2-means
+ * clustering of HIGH times.
+ * bits which can't be told apart (two HIGHs in one edge, HIGH time close
+ * to the threshold, last bit lost) make candidates, and so does an edge
+ * whose length fits both n and n+2 pulses: the other alignment is tried
+ * as well, unless it ends with edges left over.
+ * an 8-bit sum passes one wrong frame in 256, so the frame is only taken
+ * if exactly one candidate passes it; if more bits are in doubt than
+ * candidates can cover, it isn't taken at all.
+ *
+ * returns 0 if exactly one candidate passes the checksum, -EIO otherwise
+ * (data[] holds the most likely one, if any), -ENODATA if too many edges
+ * were lost
+ */
+int dht22_decode_edges(const struct dht22_edge* edges, int count, u8 data[5],
+                       struct dht22_decode_info* info)
+{
+    u32  high[DHT22_BITS];      /* HIGH time, or HIGH sum of a pair */
+    u8   pair[DHT22_BITS];      /* bit shares its HIGH edge with the next */
+    u8   good[5];
+    u32  low_sum = 0;
+    int  low_n = 0;
+    int  matches = 0;
+    int  doubt = 0;
+    int  guesses;
+    int  alignments = 1;
+    int  complete = 0;
+    int  misaligned = 0;
+    int  flip;
+    int  start;
+    int  j;
+
+    memset(info, 0, sizeof(*info));
+    memset(data, 0, 5);
+
+    start = dht22_find_data_start(edges, count);
+    if (start < 0)
+        return -ENODATA;
+
+    /* mean LOW time of this frame, from clean LOW pulses */
+    for (j = start; j < count; ++j) {
+        u32 d = edges[j].delta_ns;
+
+        if (edges[j].level && d >= 35000 && d <= 70000) {
+            low_sum += d;
+            ++low_n;
+        }
+    }
+    info->low_ns = low_n ? low_sum / low_n : DHT22_LOW_NS;
+
+    /*
+     * most likely alignment first, then the other ways of each guessed
+     * edge; the first one long enough fills info and data[]
+     */
+    for (flip = 0; flip < alignments && matches < 2; ++flip) {
+        int repaired;
+        int p;
+        int bits;
+
+        p    = realign(edges, start, count, info->low_ns, flip, high, pair,
+                       &guesses, &repaired);
+        bits = (p < 0 ? 0 : p < DHT22_PULSES ? p : DHT22_PULSES) / 2;
+        if (0 == flip) {
+            info->repaired = repaired;
+            info->bits     = bits;
+            misaligned     = p < 0;
+        }
+        /* another way may meet guesses of its own, try theirs as well */
+        if (guesses > DHT22_REALIGN_MAX)
+            doubt = 1;
+        else if (alignments < (1 << guesses))
+            alignments = 1 << guesses;
+        if (p < DHT22_PULSES - 1)
+            continue;
+
+        if (!complete)
+            info->bits = bits;
+        if (decide_bits(high, pair, bits, complete ? NULL : data, good,
+                        &matches, info))
+            doubt = 1;
+        complete = 1;
+    }
+
+    if (!complete)
+        return misaligned ? -EIO : -ENODATA;
+    if (doubt || 1 != matches)
+        return -EIO;
+    memcpy(data, good, 5);
+    return 0;
+}
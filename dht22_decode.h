@@ -0,0 +1,95 @@
+/*
+ * DHT22 Humidity And Temperature Sensor Driver, edge log decoder
+ * 
+ * Copyright (c) Edward Lin <edwardlin.tw@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * shared by the kernel module and the user-space replay tool (replay.c),
+ * no kernel-only API in here
+ */
+#ifndef _DHT22_DECODE_H
+#define _DHT22_DECODE_H
+
+#ifdef __KERNEL__
+#include <linux/types.h>
+#else
+#include <stdint.h>
+typedef uint8_t     u8;
+typedef uint32_t    u32;
+typedef uint64_t    u64;
+#endif
+
+#define DHT22_EDGES             86          /* edges of one transaction */
+#define DHT22_EDGES_MAX         96          /* room for spurious edges */
+#define DHT22_EDGES_MIN         72          /* fewer can't be repaired */
+
+/*
+ * one captured edge of the data line:
+ * level after the edge, and time since the previous edge
+ * (or since the start pulse, for the first one)
+ */
+struct dht22_edge {
+    u32     delta_ns : 31;              /* saturated at ~2.1 sec */
+    u32     level    : 1;
+};
+
+/*
+ * nominal DHT22 timings in ns, for dht22_decode_edges()
+ */
+#define DHT22_BITS              40
+#define DHT22_PULSES            (2 * DHT22_BITS)    /* LOW + HIGH per bit */
+#define DHT22_LOW_NS            50000
+#define DHT22_HIGH0_NS          26000
+#define DHT22_HIGH1_NS          70000
+#define DHT22_START_MIN_NS      500000      /* host start pulse, >= 800us */
+#define DHT22_RESPONSE_MIN_NS   60000       /* response LOW/HIGH, ~80us */
+#define DHT22_RESPONSE_MAX_NS   120000
+#define DHT22_GLITCH_NS         10000       /* shorter is a duplicate edge */
+#define DHT22_AMBIGUOUS_MAX     4           /* at most 16 candidates */
+#define DHT22_REALIGN_NS        5000        /* closer to n/n+2 is a guess */
+#define DHT22_REALIGN_MAX       3           /* at most 8 alignments */
+
+/*
+ * what dht22_decode_edges() did to get the result
+ */
+struct dht22_decode_info {
+    int     bits;               /* bits recovered from the edge log */
+    int     repaired;           /* edges standing for more than one pulse,
+                                   or duplicates */
+    int     candidates;         /* candidates tried against the checksum */
+    u32     low_ns;             /* mean LOW time of the frame */
+    u32     threshold_ns;       /* HIGH time between bit 0 and 1 */
+};
+
+int dht22_find_data_start(const struct dht22_edge* edges, int count);
+int dht22_decode_edges(const struct dht22_edge* edges, int count, u8 data[5],
+                       struct dht22_decode_info* info);
+
+/*
+ * append edge 'n' to the log, dropped if the log is full;
+ * returns the logged time, saturated
+ */
+static inline u32 dht22_log_edge(struct dht22_edge* edges, int n,
+                                 u64 delta_ns, int level)
+{
+    u32 delta = delta_ns > 0x7FFFFFFF ? 0x7FFFFFFF : (u32)delta_ns;
+
+    if (n < DHT22_EDGES_MAX) {
+        edges[n].delta_ns = delta;
+        edges[n].level    = level;
+    }
+    return delta;
+}
+
+#endif
@@ -0,0 +1,3214 @@
+/*
+ * DHT22 Humidity And Temperature Sensor Driver
+ * 
+ * Copyright (c) Edward Lin <edwardlin.tw@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ */
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/gpio.h>
+#include <linux/interrupt.h>
+#include <linux/ktime.h>
+#include <linux/time64.h>
+#include <linux/hrtimer.h>
+#include <linux/delay.h>
+#include <linux/kobject.h>
+#include <linux/types.h>
+#include <linux/fs.h>
+#include <linux/cdev.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/mm.h>
+#include <linux/wait.h>
+#include <linux/poll.h>
+#include <linux/seqlock.h>
+#include <linux/mutex.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/iio/iio.h>
+#include <linux/iio/buffer.h>
+#include <linux/iio/trigger.h>
+#include <linux/iio/trigger_consumer.h>
+#include <linux/iio/triggered_buffer.h>
+#include <net/genetlink.h>
+#include <asm/current.h>
+#include <asm/uaccess.h>
+#define _INCLUDE_DHT22_DECL
+#include "dht22.h"
+#define CREATE_TRACE_POINTS
+#include "dht22_trace.h"
+
+static const int    high = 1;
+static const int    low  = 0;
+
+/*
+ * module parameters, please refer to README.md
+ */
+static int gpio = DEFAULT_GPIO;
+module_param(gpio, int, S_IRUGO);
+MODULE_PARM_DESC(gpio, "Assigned GPIO number of DHT22 data pin, default is 4; "
+                       "ignored if 'gpios' is given");
+
+static int gpios[DHT22_SENSORS_MAX];
+static int num_gpios = 0;
+module_param_array(gpios, int, &num_gpios, S_IRUGO);
+MODULE_PARM_DESC(gpios, "GPIO numbers of DHT22 data pins, one per sensor, "
+                        "e.g. gpios=4,17,27; at most 32 sensors");
+
+static bool autoupdate = true;
+module_param(autoupdate, bool, S_IRUGO);
+MODULE_PARM_DESC(autoupdate, "automatically trigger or not, default is 1(int); "
+                             "0 is off, others are all on");
+
+static int autoupdate_sec = DEFAULT_AUTOUPDATE_SEC;
+module_param(autoupdate_sec, int, S_IRUGO);
+MODULE_PARM_DESC(autoupdate_sec, 
+                 "Seconds between two trigger events (if autoupdate is on), "
+                 "default is 10 seconds; "
+                 "the value must be >= 3(sec) and <= 60000(10min)");
+
+static int schedule = DHT22_SCHEDULE_RELATIVE;
+module_param(schedule, int, S_IRUGO);
+MODULE_PARM_DESC(schedule,
+                 "When autoupdate triggers, 0: autoupdate_sec after the "
+                 "previous trigger (default), 1: at multiples of "
+                 "autoupdate_sec of CLOCK_MONOTONIC, 2: of CLOCK_REALTIME, "
+                 "e.g. :00, :10, :20 ... with autoupdate_sec=10");
+
+static int phase_ms = 0;
+module_param(phase_ms, int, S_IRUGO);
+MODULE_PARM_DESC(phase_ms,
+                 "With schedule 1 or 2, trigger this many msec after "
+                 "each multiple of autoupdate_sec, default is 0");
+
+static int slack_us = 0;
+module_param(slack_us, int, S_IRUGO);
+MODULE_PARM_DESC(slack_us,
+                 "Allowed lateness of autoupdate triggers in usec, "
+                 "so the kernel can batch timer wakeups; default is 0, "
+                 "at most 1000000");
+
+static bool adaptive = false;
+module_param(adaptive, bool, S_IRUGO);
+MODULE_PARM_DESC(adaptive,
+                 "Adapt the autoupdate interval to how fast values change, "
+                 "between 'adaptive_sec', instead of 'autoupdate_sec'; "
+                 "default is 0(off)");
+
+static int adaptive_sec[2] = { DEFAULT_ADAPTIVE_MIN_SEC,
+                               DEFAULT_ADAPTIVE_MAX_SEC };
+static int num_adaptive_sec = 0;
+module_param_array(adaptive_sec, int, &num_adaptive_sec, S_IRUGO);
+MODULE_PARM_DESC(adaptive_sec,
+                 "Minimal and maximal adaptive interval in seconds, "
+                 "default is 3,120");
+
+static int adaptive_rate[2] = { DEFAULT_ADAPTIVE_RATE_H,
+                                DEFAULT_ADAPTIVE_RATE_T };
+static int num_adaptive_rate = 0;
+module_param_array(adaptive_rate, int, &num_adaptive_rate, S_IRUGO);
+MODULE_PARM_DESC(adaptive_rate,
+                 "Humidity and temperature changes per minute, in 0.1 %RH "
+                 "and 0.1 °C, above which the adaptive interval drops to "
+                 "its minimum; default is 10,5");
+
+static int idle_sec = 0;
+module_param(idle_sec, int, S_IRUGO);
+MODULE_PARM_DESC(idle_sec,
+                 "Pause autoupdate after this many seconds without any "
+                 "reader (open device node, IIO buffer or sysfs read); "
+                 "default is 0, never pause");
+
+static int netlink_batch_ms = DEFAULT_NETLINK_BATCH_MS;
+module_param(netlink_batch_ms, int, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(netlink_batch_ms,
+                 "Readings of all sensors within this many msec are "
+                 "multicast in one netlink datagram, default is 100; "
+                 "0 sends each at once, at most 1000; "
+                 "writable in /sys/module/dht22/parameters");
+
+static int retries = DEFAULT_RETRIES;
+module_param(retries, int, S_IRUGO);
+MODULE_PARM_DESC(retries,
+                 "Retries of a failed read (CRC error or timeout), default is 3; "
+                 "the first one 2 sec after the failure, then doubled "
+                 "up to 16 sec; 0 to disable, at most 5");
+
+static int capture = DHT22_CAPTURE_IRQ;
+module_param(capture, int, S_IRUGO);
+MODULE_PARM_DESC(capture,
+                 "How edges are captured, 0: one interrupt per edge (default), "
+                 "1: sampling the line with interrupts disabled for ~5ms, "
+                 "for boards whose IRQ latency loses edges");
+
+static int deadband[2];
+static int num_deadband = 0;
+module_param_array(deadband, int, &num_deadband, S_IRUGO);
+MODULE_PARM_DESC(deadband,
+                 "Notify pollers only if humidity or temperature moved by "
+                 "at least this much since the last notification, "
+                 "in 0.1 %RH and 0.1 °C, e.g. deadband=5,2; "
+                 "default is 0,0: every reading");
+
+static int heartbeat_sec = DEFAULT_HEARTBEAT_SEC;
+module_param(heartbeat_sec, int, S_IRUGO);
+MODULE_PARM_DESC(heartbeat_sec,
+                 "With a deadband, notify anyway after this many seconds "
+                 "without a notification, default is 600; 0 to disable");
+
+/*
+ * module's attributes; please refer to README.md
+ * all but 'debug' are per sensor, under /sys/kernel/dht22/sensor<n>
+ */
+static ATTR_RO(gpio);
+static ATTR_RW(autoupdate);
+static ATTR_RW(autoupdate_sec);
+static ATTR_RW(schedule);
+static ATTR_RW(phase_ms);
+static ATTR_RW(slack_us);
+static ATTR_RW(adaptive);
+static ATTR_RW(adaptive_sec);
+static ATTR_RW(adaptive_rate);
+static ATTR_RO(interval_sec);
+static ATTR_RW(idle_sec);
+static ATTR_RO(consumers);
+static ATTR_RO(humidity);
+static ATTR_RO(temperature);
+static ATTR_RO(reading);
+static ATTR_WO(trigger);
+static ATTR_RW(max_age_ms);
+static ATTR_RW(retries);
+static ATTR_RO(retry_stats);
+static ATTR_RW(capture);
+static ATTR_RO(capture_stats);
+static ATTR_RW(deadband);
+static ATTR_RW(heartbeat_sec);
+static ATTR_RO(stats);
+static ATTR_RW(stats_windows);
+static ATTR_RO(ewma);
+static ATTR_RW(ewma_alpha);
+static ATTR_WO(debug);
+
+static struct attribute* dht22_attrs[] = {
+    &gpio_attr.attr,
+    &autoupdate_attr.attr,
+    &autoupdate_sec_attr.attr,
+    &schedule_attr.attr,
+    &phase_ms_attr.attr,
+    &slack_us_attr.attr,
+    &adaptive_attr.attr,
+    &adaptive_sec_attr.attr,
+    &adaptive_rate_attr.attr,
+    &interval_sec_attr.attr,
+    &idle_sec_attr.attr,
+    &consumers_attr.attr,
+    &humidity_attr.attr,
+    &temperature_attr.attr,
+    &reading_attr.attr,
+    &trigger_attr.attr,
+    &max_age_ms_attr.attr,
+    &retries_attr.attr,
+    &retry_stats_attr.attr,
+    &capture_attr.attr,
+    &capture_stats_attr.attr,
+    &deadband_attr.attr,
+    &heartbeat_sec_attr.attr,
+    &stats_attr.attr,
+    &stats_windows_attr.attr,
+    &ewma_attr.attr,
+    &ewma_alpha_attr.attr,
+    NULL
+};
+
+static struct attribute_group attr_group = {
+    .attrs = dht22_attrs,
+};
+
+static struct kobj_type dht22_ktype = {
+    .release    = dht22_kobj_release,
+    .sysfs_ops  = &kobj_sysfs_ops,
+};
+
+/*
+ * device node
+ * must add a rule file to RPi '/etc/udev/rules.d/51-dht22.rules' 
+ * content:
+ * KERNEL="dht22:[0-9]*", GROUP="root", MODE="0444"
+ */
+static int                      device_major = 0;
+static int                      num_devs = 0;
+static struct cdev              dht22_cdev;
+static struct class*            dht22_class = NULL;
+static struct file_operations   dht22_fops = {
+    .open       = dev_open,
+};
+static struct file_operations   dht22_fops_h = {
+    .open       = dev_open_h,
+    .read       = dev_read_h,
+    .llseek     = default_llseek,
+    .poll       = dev_poll,
+    .mmap       = dev_mmap,
+    .unlocked_ioctl = dev_ioctl,
+    .release    = dev_close,
+};
+static struct file_operations   dht22_fops_t = {
+    .open       = dev_open_t,
+    .read       = dev_read_t,
+    .llseek     = default_llseek,
+    .poll       = dev_poll,
+    .mmap       = dev_mmap,
+    .unlocked_ioctl = dev_ioctl,
+    .release    = dev_close,
+};
+static struct file_operations   dht22_fops_r = {
+    .open       = dev_open_r,
+    .read       = dev_read_r,
+    .llseek     = default_llseek,
+    .poll       = dev_poll,
+    .mmap       = dev_mmap,
+    .unlocked_ioctl = dev_ioctl,
+    .release    = dev_close,
+};
+static const struct file_operations edges_fops = {
+    .open       = edges_open,
+    .read       = seq_read,
+    .llseek     = seq_lseek,
+    .release    = single_release,
+};
+static const struct file_operations hist_fops = {
+    .open       = hist_open,
+    .read       = seq_read,
+    .llseek     = seq_lseek,
+    .release    = single_release,
+};
+static struct file_operations   dht22_fops_history = {
+    .read       = dev_read_history,
+    .llseek     = dev_llseek_history,
+    .poll       = dev_poll_history,
+    .release    = dev_close,
+};
+
+/* 
+ * other global static vars
+ */
+static const int            timeout_time = 1;  /* 1 second */
+static const int            timeout_time_ms = 500; /* 0.5 second */
+static struct kobject*      dht22_kobj;        /* /sys/kernel/dht22 */
+static struct dentry*       dht22_debugfs;     /* /sys/kernel/debug/dht22 */
+static struct dht22_sensor* sensors[DHT22_SENSORS_MAX];
+static int                  num_sensors = 0;
+static bool                 dbg_flag = false;  /* log more info if true */
+/* rolling windows of 'stats', 1 min, 1 hour and 1 day */
+static const u32            default_windows[DHT22_STATS_WINDOWS] = {
+                                60, 3600, 86400 };
+
+static int __init dht22_init(void)
+{
+    int     ret;
+    int     i;
+
+    pr_err("Loading dht22 module...\n");
+
+    /* 'gpios' not given, fall back to single sensor on 'gpio' */
+    if (0 == num_gpios) {
+        gpios[0]  = gpio;
+        num_gpios = 1;
+    }
+
+    /* kobject, parent of all sensors' directories */
+    dht22_kobj = kobject_create_and_add("dht22", kernel_kobj);
+    if (NULL == dht22_kobj) {
+        pr_err("DHT22 failed to create kobject mapping\n");
+        return -EINVAL;
+    }
+    ret = sysfs_create_file(dht22_kobj, &debug_attr.attr);
+    if (ret) {
+        pr_err("DHT22 failed to create sysfs file.\n");
+        goto sysfs_err;
+    }
+
+    /* debug only, the driver works without it */
+    dht22_debugfs = debugfs_create_dir("dht22", NULL);
+    if (IS_ERR_OR_NULL(dht22_debugfs))
+        dht22_debugfs = NULL;
+
+    for (i = 0; i < num_gpios; ++i) {
+        ret = dht22_sensor_init(i, gpios[i]);
+        if (ret)
+            goto sensor_err;
+    }
+
+    /* device node, 2 nodes for each sensor */
+    ret = dht22_dev_init();
+    if (ret)
+        goto sensor_err;
+
+    /* the driver works without it */
+    dht22_genl_init();
+
+    pr_err("dht22 loaded, %d sensor(s).\n", num_sensors);
+
+    return 0;
+
+sensor_err:
+    while (num_sensors > 0)
+        dht22_sensor_exit(sensors[--num_sensors]);
+
+    debugfs_remove_recursive(dht22_debugfs);
+
+sysfs_err:
+    kobject_put(dht22_kobj);
+    return ret;
+}
+
+static void __exit dht22_exit(void)
+{
+    dht22_genl_exit();
+    dht22_dev_exit();
+    while (num_sensors > 0)
+        dht22_sensor_exit(sensors[--num_sensors]);
+    debugfs_remove_recursive(dht22_debugfs);
+    kobject_put(dht22_kobj);
+    pr_err("dht22 unloaded.\n");
+}
+
+/*
+ * setup GPIO, IRQ, sysfs directory and timers of sensor 'id';
+ * on success, the sensor is appended to 'sensors'
+ */
+static int dht22_sensor_init(int id, int gpio)
+{
+    struct dht22_sensor*    sensor;
+    int                     ret;
+
+    if (!gpio_is_valid(gpio)) {
+        pr_err("dht22 can't validate GPIO %d; unloaded\n", gpio);
+        return -EINVAL;
+    }
+
+    sensor = kzalloc(sizeof(*sensor), GFP_KERNEL);
+    if (NULL == sensor)
+        return -ENOMEM;
+
+    sensor->id             = id;
+    sensor->gpio           = gpio;
+    sensor->autoupdate     = autoupdate;
+    sensor->autoupdate_sec = autoupdate_sec;
+    sensor->schedule       = schedule >= 0 && schedule < DHT22_SCHEDULES ?
+                             schedule : DHT22_SCHEDULE_RELATIVE;
+    sensor->phase_ms       = max(phase_ms, 0);
+    sensor->slack_us       = clamp(slack_us, 0, SLACK_US_MAX);
+    mutex_init(&sensor->autoupdate_lock);
+    sensor->adaptive         = adaptive;
+    sensor->adaptive_sec[0]  = clamp(adaptive_sec[0], AUTOUPDATE_SEC_MIN,
+                                     AUTOUPDATE_SEC_MAX);
+    sensor->adaptive_sec[1]  = clamp(adaptive_sec[1], sensor->adaptive_sec[0],
+                                     AUTOUPDATE_SEC_MAX);
+    sensor->adaptive_rate[0] = max(adaptive_rate[0], 0);
+    sensor->adaptive_rate[1] = max(adaptive_rate[1], 0);
+    sensor->interval_sec     = sensor->adaptive_sec[0];
+    sensor->idle_sec         = max(idle_sec, 0);
+    sensor->last_active      = jiffies;
+    sensor->retries        = clamp(retries, 0, DHT22_RETRIES_MAX);
+    sensor->capture        = DHT22_CAPTURE_POLL == capture ? capture :
+                                                             DHT22_CAPTURE_IRQ;
+    sensor->deadband[0]    = clamp(deadband[0], 0, DEADBAND_MAX);
+    sensor->deadband[1]    = clamp(deadband[1], 0, DEADBAND_MAX);
+    sensor->heartbeat_sec  = max(heartbeat_sec, 0);
+    sensor->state          = dht22_idle;
+    seqcount_init(&sensor->reading_seqcount);
+    spin_lock_init(&sensor->history_lock);
+    init_waitqueue_head(&sensor->wait);
+    init_waitqueue_head(&sensor->history_wait);
+    init_waitqueue_head(&sensor->done_wait);
+    /* DHT22 is warming up, as if just triggered; see request_conversion() */
+    sensor->trigger_ns = ktime_get_ns();
+    render_texts(&sensor->texts, &sensor->reading);
+    mutex_init(&sensor->last_edges_lock);
+    stats_init(sensor);
+    INIT_WORK(&sensor->process_work, process_results);
+    INIT_WORK(&sensor->capture_work, poll_capture);
+    sensor->hist_high.step_ns = DHT22_HIST_HIGH_STEP_NS;
+
+    sensor->shm = (struct dht22_shm*)get_zeroed_page(GFP_KERNEL);
+    if (NULL == sensor->shm) {
+        kfree(sensor);
+        return -ENOMEM;
+    }
+
+    /*
+     * from now on, kobject_put() frees 'sensor'
+     */
+    ret = kobject_init_and_add(&sensor->kobj, &dht22_ktype, dht22_kobj,
+                               "sensor%d", id);
+    if (ret) {
+        pr_err("DHT22 failed to create kobject of sensor %d\n", id);
+        goto kobj_err;
+    }
+
+    ret = gpio_request(gpio, "sysfs");
+    if (ret < 0) {
+        pr_err("dht22 failed to request GPIO %d, unloaded\n",gpio);
+        goto kobj_err;
+    }
+
+    gpio_export(gpio, true);
+    gpio_direction_output(gpio, high);
+
+    /* setup interrupt handler */
+    sensor->irq_number = gpio_to_irq(gpio);
+    if (sensor->irq_number < 0) {
+        pr_err("dht22 failed to get IRQ for GPIO %d, unloaded\n", gpio);
+        ret = sensor->irq_number;
+        goto free_gpio;
+    }
+    pr_err("dht22 assign IRQ %d to GPIO %d.\n", sensor->irq_number, gpio);
+    ret = request_irq(sensor->irq_number,
+            dht22_irq_handler,
+            IRQF_TRIGGER_RISING | IRQF_TRIGGER_FALLING,
+            "dht22_irq_handler",
+            sensor);
+    if (ret < 0) {
+        pr_err("idht22 failed to request IRQ, unloaded.\n");
+        goto free_gpio;
+    }
+
+    /* sysfs attribute */
+    ret = sysfs_create_group(&sensor->kobj, &attr_group);
+    if (ret) {
+        pr_err("DHT22 failed to create sysfs group.\n");
+        goto free_irq;
+    }
+
+    /*
+     * wait for 2sec (for DHT22 warming up) for the first trigger
+     * no matter autoupdate is ON or OFF
+     * at least DHT22 will be triggered once
+     */
+    dht22_timer_init(&sensor->autoupdate_timer, autoupdate_func, true, 2);
+    /*
+     * setup timeout timer, but not start yet
+     * it'll start when triggering DHT22 to request data
+     */
+    dht22_timer_init(&sensor->timeout_timer, timeout_func, false, 0);
+    dht22_timer_init(&sensor->retry_timer, retry_func, false, 0);
+    dht22_timer_init(&sensor->start_timer, start_func, false, 0);
+    dht22_timer_init(&sensor->fresh_timer, fresh_func, false, 0);
+
+    dht22_debugfs_init(sensor);
+    dht22_iio_init(sensor);
+
+    sensors[num_sensors++] = sensor;
+    return 0;
+
+free_irq:
+    free_irq(sensor->irq_number, sensor);
+
+free_gpio:
+    gpio_unexport(gpio);
+    gpio_free(gpio);
+
+kobj_err:
+    kobject_put(&sensor->kobj);
+    return ret;
+}
+
+static void dht22_sensor_exit(struct dht22_sensor* sensor)
+{
+    int i;
+
+    debugfs_remove_recursive(sensor->debugfs);
+    /* no more 'trigger' from user space */
+    sysfs_remove_group(&sensor->kobj, &attr_group);
+    /* no more IIO postenable (consumer_get()) from user space */
+    dht22_iio_unregister(sensor);
+    /*
+     * no more triggers, retries or autoupdate_restart() from now on,
+     * whoever calls them; under autoupdate_lock, which
+     * autoupdate_restart() checks it under
+     */
+    mutex_lock(&sensor->autoupdate_lock);
+    WRITE_ONCE(sensor->dying, true);
+    mutex_unlock(&sensor->autoupdate_lock);
+    smp_mb();
+    /*
+     * twice: a timer or work already running when 'dying' was set may
+     * still arm one cancelled before it; nothing running later does
+     */
+    for (i = 0; i < 2; ++i) {
+        hrtimer_cancel(&sensor->autoupdate_timer);
+        hrtimer_cancel(&sensor->retry_timer);
+        hrtimer_cancel(&sensor->fresh_timer);
+        hrtimer_cancel(&sensor->start_timer);
+        hrtimer_cancel(&sensor->timeout_timer);
+        /* poll_capture() disables/enables the IRQ, done before free */
+        cancel_work_sync(&sensor->capture_work);
+        cancel_work_sync(&sensor->process_work);
+    }
+    free_irq(sensor->irq_number, sensor);
+    cancel_work_sync(&sensor->process_work);
+    dht22_iio_exit(sensor);
+    gpio_unexport(sensor->gpio);
+    gpio_free(sensor->gpio);
+    kobject_put(&sensor->kobj);
+}
+
+/*
+ * /sys/kernel/debug/dht22/sensor<id>/
+ *     edges                    edge log of the last transaction
+ *     fail_{timeout,edges,crc,busy}    failure counters
+ *     hist_{irq,latency,wq_delay,high} histograms
+ * failure is not fatal, the sensor works without debugfs
+ */
+static int dht22_debugfs_init(struct dht22_sensor* sensor)
+{
+    char name[16];
+
+    if (NULL == dht22_debugfs)
+        return -ENODEV;
+
+    sprintf(name, "sensor%d", sensor->id);
+    sensor->debugfs = debugfs_create_dir(name, dht22_debugfs);
+    if (IS_ERR_OR_NULL(sensor->debugfs))
+        return -ENODEV;
+
+    debugfs_create_file("edges", S_IRUSR, sensor->debugfs, sensor,
+                        &edges_fops);
+
+    debugfs_create_atomic_t("fail_timeout", S_IRUSR, sensor->debugfs,
+                            &sensor->fail_timeout);
+    debugfs_create_atomic_t("fail_edges", S_IRUSR, sensor->debugfs,
+                            &sensor->fail_edges);
+    debugfs_create_atomic_t("fail_crc", S_IRUSR, sensor->debugfs,
+                            &sensor->fail_crc);
+    debugfs_create_atomic_t("fail_busy", S_IRUSR, sensor->debugfs,
+                            &sensor->fail_busy);
+
+    debugfs_create_file("hist_irq", S_IRUSR, sensor->debugfs,
+                        &sensor->hist_irq, &hist_fops);
+    debugfs_create_file("hist_latency", S_IRUSR, sensor->debugfs,
+                        &sensor->hist_latency, &hist_fops);
+    debugfs_create_file("hist_wq_delay", S_IRUSR, sensor->debugfs,
+                        &sensor->hist_wq_delay, &hist_fops);
+    debugfs_create_file("hist_high", S_IRUSR, sensor->debugfs,
+                        &sensor->hist_high, &hist_fops);
+    return 0;
+}
+
+static int edges_open(struct inode* inode, struct file* file)
+{
+    return single_open(file, edges_show, inode->i_private);
+}
+
+/*
+ * edge log of last decoded transaction, in the format of
+ * DOC/dht22_interrupts_*.txt (time is usec since the previous edge)
+ */
+static int edges_show(struct seq_file* m, void* v)
+{
+    struct dht22_sensor* sensor = m->private;
+    int                  i;
+
+    mutex_lock(&sensor->last_edges_lock);
+    seq_printf(m, "Interrupt sequence of sensor %d (%d interrupts) at %llu ns\n",
+               sensor->id, sensor->last_edge_count, sensor->last_edges_ns);
+    seq_puts(m, "value: GPIO value, 0(LOW) and 1(HIGH)\n");
+    seq_puts(m, "TIME : usec\n\n");
+    for (i = 0; i < sensor->last_edge_count; ++i) {
+        const struct dht22_edge* e = &sensor->last_edges[i];
+
+        seq_printf(m, "....interrupt %d, value(%d), time(%u)\n",
+                   i, e->level, e->delta_ns / (u32)NSEC_PER_USEC);
+    }
+    mutex_unlock(&sensor->last_edges_lock);
+
+    return 0;
+}
+
+static int hist_open(struct inode* inode, struct file* file)
+{
+    return single_open(file, hist_show, inode->i_private);
+}
+
+/*
+ * one line per bucket, up to the last non-empty one:
+ * "<from ns> <to ns> <count>", the last bucket has no upper bound
+ */
+static int hist_show(struct seq_file* m, void* v)
+{
+    struct dht22_hist* hist = m->private;
+    int                last = -1;
+    int                i;
+
+    for (i = 0; i < DHT22_HIST_BUCKETS; ++i) {
+        if (atomic_read(&hist->count[i]))
+            last = i;
+    }
+
+    for (i = 0; i <= last; ++i) {
+        u64 from = hist->step_ns ? (u64)i * hist->step_ns :
+                                   (i ? 1ULL << i : 0);
+        u64 to   = hist->step_ns ? from + hist->step_ns : 2ULL << i;
+
+        if (DHT22_HIST_BUCKETS - 1 == i)
+            seq_printf(m, "%10llu          - %u\n", from,
+                       atomic_read(&hist->count[i]));
+        else
+            seq_printf(m, "%10llu %10llu %u\n", from, to - 1,
+                       atomic_read(&hist->count[i]));
+    }
+
+    return 0;
+}
+
+static void hist_add(struct dht22_hist* hist, u64 ns)
+{
+    u64 i = hist->step_ns ? div_u64(ns, hist->step_ns) : fls64(ns >> 1);
+
+    atomic_inc(&hist->count[min_t(u64, i, DHT22_HIST_BUCKETS - 1)]);
+}
+
+#if IS_ENABLED(CONFIG_IIO_TRIGGERED_BUFFER)
+/*
+ * IIO device of each sensor, /sys/bus/iio/devices/iio:device<N>
+ * and /dev/iio:device<N>; humidity and temperature in 0.1 % and 0.1 °C,
+ * scale 100 for IIO's milli units
+ */
+#define DHT22_IIO_CHANNEL(_type, _index) {                  \
+    .type               = _type,                            \
+    .info_mask_separate = BIT(IIO_CHAN_INFO_RAW) |          \
+                          BIT(IIO_CHAN_INFO_SCALE),         \
+    .scan_index         = _index,                           \
+    .scan_type          = {                                 \
+        .sign           = 's',                              \
+        .realbits       = 32,                               \
+        .storagebits    = 32,                               \
+        .endianness     = IIO_CPU,                          \
+    },                                                      \
+}
+
+static const struct iio_chan_spec dht22_iio_channels[] = {
+    DHT22_IIO_CHANNEL(IIO_HUMIDITYRELATIVE, 0),
+    DHT22_IIO_CHANNEL(IIO_TEMP, 1),
+    IIO_CHAN_SOFT_TIMESTAMP(2),
+};
+
+static struct dht22_sensor* dht22_iio_sensor(struct iio_dev* indio_dev)
+{
+    return *(struct dht22_sensor**)iio_priv(indio_dev);
+}
+
+static int dht22_iio_read_raw(struct iio_dev* indio_dev,
+                              struct iio_chan_spec const* chan,
+                              int* val, int* val2, long mask)
+{
+    struct dht22_record reading;
+
+    switch (mask) {
+    case IIO_CHAN_INFO_RAW:
+        get_reading(dht22_iio_sensor(indio_dev), &reading);
+        if (0 == reading.seq)
+            return -ENODATA;
+        *val = IIO_TEMP == chan->type ? reading.temperature :
+                                        reading.humidity;
+        return IIO_VAL_INT;
+
+    case IIO_CHAN_INFO_SCALE:
+        *val = 100;
+        return IIO_VAL_INT;
+    }
+
+    return -EINVAL;
+}
+
+static const struct iio_info dht22_iio_info = {
+    .driver_module  = THIS_MODULE,
+    .read_raw       = dht22_iio_read_raw,
+};
+
+/*
+ * no owner: the trigger is only used by the sensor's own IIO device,
+ * whose reference on it would otherwise pin this module forever
+ */
+static const struct iio_trigger_ops dht22_iio_trigger_ops = {
+};
+
+/*
+ * an enabled buffer is a consumer of the sensor, see autoupdate_idle()
+ */
+static int dht22_iio_postenable(struct iio_dev* indio_dev)
+{
+    int ret = iio_triggered_buffer_postenable(indio_dev);
+
+    if (0 == ret)
+        consumer_get(dht22_iio_sensor(indio_dev));
+    return ret;
+}
+
+static int dht22_iio_predisable(struct iio_dev* indio_dev)
+{
+    consumer_put(dht22_iio_sensor(indio_dev));
+    return iio_triggered_buffer_predisable(indio_dev);
+}
+
+static const struct iio_buffer_setup_ops dht22_iio_buffer_ops = {
+    .postenable = dht22_iio_postenable,
+    .predisable = dht22_iio_predisable,
+};
+
+/*
+ * push the latest reading, timestamped when its conversion completed
+ * (in the clock selected for the IIO device)
+ */
+static irqreturn_t dht22_iio_trigger_handler(int irq, void* p)
+{
+    struct iio_poll_func* pf = p;
+    struct iio_dev*       indio_dev = pf->indio_dev;
+    struct dht22_record   reading;
+    struct {
+        s32     channels[2];
+        s64     timestamp __aligned(8);
+    } scan;
+    int                   bit;
+    int                   i = 0;
+    s64                   age;
+
+    get_reading(dht22_iio_sensor(indio_dev), &reading);
+    if (0 == reading.seq)
+        goto done;
+
+    memset(&scan, 0, sizeof(scan));
+    for_each_set_bit(bit, indio_dev->active_scan_mask, indio_dev->masklength) {
+        if (bit < ARRAY_SIZE(scan.channels))
+            scan.channels[i++] = 0 == bit ? reading.humidity :
+                                            reading.temperature;
+    }
+
+    age = ktime_get_ns() - reading.timestamp_ns;
+    iio_push_to_buffers_with_timestamp(indio_dev, &scan,
+                                       iio_get_time_ns(indio_dev) - age);
+done:
+    iio_trigger_notify_done(indio_dev->trig);
+    return IRQ_HANDLED;
+}
+
+/*
+ * failure is not fatal, the sensor works without IIO
+ */
+static int dht22_iio_init(struct dht22_sensor* sensor)
+{
+    struct iio_dev*     indio_dev;
+    struct iio_trigger* trig;
+    int                 ret;
+
+    indio_dev = iio_device_alloc(sizeof(sensor));
+    if (NULL == indio_dev)
+        return -ENOMEM;
+
+    *(struct dht22_sensor**)iio_priv(indio_dev) = sensor;
+    indio_dev->name         = "dht22";
+    indio_dev->modes        = INDIO_DIRECT_MODE;
+    indio_dev->info         = &dht22_iio_info;
+    indio_dev->channels     = dht22_iio_channels;
+    indio_dev->num_channels = ARRAY_SIZE(dht22_iio_channels);
+
+    /* "dht22-sensor<n>", fired by process_results() */
+    trig = iio_trigger_alloc("dht22-sensor%d", sensor->id);
+    if (NULL == trig) {
+        ret = -ENOMEM;
+        goto free_dev;
+    }
+    trig->ops = &dht22_iio_trigger_ops;
+    ret = iio_trigger_register(trig);
+    if (ret)
+        goto free_trig;
+
+    ret = iio_triggered_buffer_setup(indio_dev, NULL,
+                                     dht22_iio_trigger_handler,
+                                     &dht22_iio_buffer_ops);
+    if (ret)
+        goto unregister_trig;
+    /* put by iio_device_free() */
+    indio_dev->trig = iio_trigger_get(trig);
+
+    ret = iio_device_register(indio_dev);
+    if (ret)
+        goto cleanup_buffer;
+
+    sensor->iio_trig = trig;
+    sensor->iio      = indio_dev;
+    return 0;
+
+cleanup_buffer:
+    iio_triggered_buffer_cleanup(indio_dev);
+unregister_trig:
+    iio_trigger_unregister(trig);
+free_trig:
+    iio_trigger_free(trig);
+free_dev:
+    iio_device_free(indio_dev);
+    pr_err("DHT22 failed to register IIO device of sensor %d\n", sensor->id);
+    return ret;
+}
+
+/*
+ * first step of removal, disables the buffer; the trigger stays for
+ * process_results() until dht22_iio_exit()
+ */
+static void dht22_iio_unregister(struct dht22_sensor* sensor)
+{
+    if (sensor->iio)
+        iio_device_unregister(sensor->iio);
+}
+
+static void dht22_iio_exit(struct dht22_sensor* sensor)
+{
+    if (NULL == sensor->iio)
+        return;
+
+    iio_triggered_buffer_cleanup(sensor->iio);
+    iio_trigger_unregister(sensor->iio_trig);
+    iio_device_free(sensor->iio);
+    iio_trigger_free(sensor->iio_trig);
+}
+
+/* process context, from process_results() */
+static void dht22_iio_push(struct dht22_sensor* sensor)
+{
+    if (sensor->iio_trig)
+        iio_trigger_poll_chained(sensor->iio_trig);
+}
+#else
+static int  dht22_iio_init(struct dht22_sensor* sensor) { return -ENODEV; }
+static void dht22_iio_unregister(struct dht22_sensor* sensor) { }
+static void dht22_iio_exit(struct dht22_sensor* sensor) { }
+static void dht22_iio_push(struct dht22_sensor* sensor) { }
+#endif /* CONFIG_IIO_TRIGGERED_BUFFER */
+
+/*
+ * generic netlink family "dht22", see dht22_user.h;
+ * readings are appended to genl_batch, multicast once per
+ * netlink_batch_ms by genl_batch_work (or right away if 0 or full),
+ * a single send however many listeners
+ */
+static void genl_batch_func(struct work_struct* work);
+static int  dht22_genl_get(struct sk_buff* skb, struct genl_info* info);
+static int  dht22_genl_bind(struct net* net, int group);
+
+static struct genl_family dht22_genl_family = {
+    .id         = GENL_ID_GENERATE,
+    .name       = DHT22_GENL_NAME,
+    .version    = DHT22_GENL_VERSION,
+    .maxattr    = DHT22_A_MAX,
+    .mcast_bind = dht22_genl_bind,
+};
+
+static const struct nla_policy dht22_genl_policy[DHT22_A_MAX + 1] = {
+    [DHT22_A_SENSOR]    = { .type = NLA_U32 },
+};
+
+static const struct genl_ops dht22_genl_ops[] = {
+    {
+        .cmd    = DHT22_CMD_GET,
+        .doit   = dht22_genl_get,
+        .policy = dht22_genl_policy,
+    },
+};
+
+static const struct genl_multicast_group dht22_genl_mcgrps[] = {
+    { .name = DHT22_GENL_MCGRP },
+};
+
+static bool                 genl_registered = false;
+static DEFINE_MUTEX(genl_batch_lock);
+static struct sk_buff*      genl_batch;
+static DECLARE_DELAYED_WORK(genl_batch_work, genl_batch_func);
+
+static int dht22_genl_init(void)
+{
+    int ret = genl_register_family_with_ops_groups(&dht22_genl_family,
+                                                   dht22_genl_ops,
+                                                   dht22_genl_mcgrps);
+    if (ret) {
+        pr_err("DHT22 failed to register generic netlink family\n");
+        return ret;
+    }
+
+    genl_registered = true;
+    return 0;
+}
+
+static void dht22_genl_exit(void)
+{
+    if (!genl_registered)
+        return;
+
+    /* no more batches from process_results() */
+    mutex_lock(&genl_batch_lock);
+    genl_registered = false;
+    nlmsg_free(genl_batch);
+    genl_batch = NULL;
+    mutex_unlock(&genl_batch_lock);
+
+    cancel_delayed_work_sync(&genl_batch_work);
+    genl_unregister_family(&dht22_genl_family);
+}
+
+/* a subscriber is a consumer of every sensor, see autoupdate_idle() */
+static bool dht22_genl_listening(void)
+{
+    return genl_registered &&
+           genl_has_listeners(&dht22_genl_family, &init_net, 0);
+}
+
+static int dht22_genl_bind(struct net* net, int group)
+{
+    int i;
+
+    for (i = 0; i < num_sensors; ++i)
+        consumer_seen(sensors[i]);
+    return 0;
+}
+
+static size_t dht22_genl_msg_size(void)
+{
+    return nlmsg_total_size(GENL_HDRLEN +
+                            nla_total_size(sizeof(u32)) * 2 +
+                            nla_total_size(sizeof(s32)) * 2 +
+                            nla_total_size_64bit(sizeof(u64)) * 2);
+}
+
+static int dht22_genl_fill(struct sk_buff* skb, void* hdr, int id,
+                           const struct dht22_record* rec)
+{
+    if (nla_put_u32(skb, DHT22_A_SENSOR, id) ||
+        nla_put_u64_64bit(skb, DHT22_A_SEQ, rec->seq, DHT22_A_PAD) ||
+        nla_put_u64_64bit(skb, DHT22_A_TIMESTAMP, rec->timestamp_ns,
+                          DHT22_A_PAD) ||
+        nla_put_s32(skb, DHT22_A_HUMIDITY, rec->humidity) ||
+        nla_put_s32(skb, DHT22_A_TEMPERATURE, rec->temperature) ||
+        nla_put_u32(skb, DHT22_A_STATUS, rec->status)) {
+        genlmsg_cancel(skb, hdr);
+        return -EMSGSIZE;
+    }
+
+    genlmsg_end(skb, hdr);
+    return 0;
+}
+
+/* send what's in genl_batch, under genl_batch_lock */
+static void genl_batch_flush(void)
+{
+    if (genl_batch)
+        genlmsg_multicast(&dht22_genl_family, genl_batch, 0, 0, GFP_KERNEL);
+    genl_batch = NULL;
+}
+
+static void genl_batch_func(struct work_struct* work)
+{
+    mutex_lock(&genl_batch_lock);
+    genl_batch_flush();
+    mutex_unlock(&genl_batch_lock);
+}
+
+/*
+ * from process_results(), for every conversion; nothing is built
+ * while nobody subscribes
+ */
+static void dht22_genl_send(struct dht22_sensor* sensor,
+                            const struct dht22_record* reading)
+{
+    int   batch_ms = clamp(READ_ONCE(netlink_batch_ms), 0,
+                           NETLINK_BATCH_MS_MAX);
+    bool  first = false;
+    void* hdr;
+
+    if (!dht22_genl_listening())
+        return;
+
+    mutex_lock(&genl_batch_lock);
+    if (!genl_registered)
+        goto out;
+    if (genl_batch && skb_tailroom(genl_batch) < dht22_genl_msg_size())
+        genl_batch_flush();
+    if (NULL == genl_batch) {
+        genl_batch = nlmsg_new(NLMSG_GOODSIZE, GFP_KERNEL);
+        if (NULL == genl_batch)
+            goto out;
+        first = true;
+    }
+
+    hdr = genlmsg_put(genl_batch, 0, 0, &dht22_genl_family, 0,
+                      DHT22_CMD_READING);
+    if (hdr)
+        dht22_genl_fill(genl_batch, hdr, sensor->id, reading);
+
+    if (0 == batch_ms)
+        genl_batch_flush();
+    else if (first)
+        schedule_delayed_work(&genl_batch_work, msecs_to_jiffies(batch_ms));
+
+out:
+    mutex_unlock(&genl_batch_lock);
+}
+
+/* DHT22_CMD_GET, latest reading of sensor DHT22_A_SENSOR */
+static int dht22_genl_get(struct sk_buff* skb, struct genl_info* info)
+{
+    struct dht22_record rec;
+    struct sk_buff*     msg;
+    void*               hdr;
+    u32                 id;
+    int                 ret;
+
+    if (NULL == info->attrs[DHT22_A_SENSOR])
+        return -EINVAL;
+    id = nla_get_u32(info->attrs[DHT22_A_SENSOR]);
+    if (id >= num_sensors)
+        return -ENODEV;
+
+    msg = nlmsg_new(dht22_genl_msg_size(), GFP_KERNEL);
+    if (NULL == msg)
+        return -ENOMEM;
+
+    hdr = genlmsg_put_reply(msg, info, &dht22_genl_family, 0,
+                            DHT22_CMD_READING);
+    if (NULL == hdr) {
+        nlmsg_free(msg);
+        return -EMSGSIZE;
+    }
+
+    get_reading(sensors[id], &rec);
+    ret = dht22_genl_fill(msg, hdr, id, &rec);
+    if (ret) {
+        nlmsg_free(msg);
+        return ret;
+    }
+
+    return genlmsg_reply(msg, info);
+}
+
+static void dht22_kobj_release(struct kobject* kobj)
+{
+    struct dht22_sensor* sensor = to_dht22_sensor(kobj);
+
+    /* still alive if mapped by someone, the mapping holds a reference */
+    free_page((unsigned long)sensor->shm);
+    kfree(sensor);
+}
+
+/* to create, for each sensor n
+ * "/dev/dht22:<2n>"          for reading humidity,
+ * "/dev/dht22:<2n+1>"        for reading temperature,
+ * "/dev/dht22_history:<n>"   for reading records of last conversions, and
+ * "/dev/dht22_reading:<n>"   for reading humidity and temperature together
+ */
+static int dht22_dev_init(void)
+{
+    dev_t dev = MKDEV(device_major, 0); /* dynamic allocation of 'major' */
+    int   alloc_ret = -1;
+    int   cdev_err = -1;
+    int   i;
+
+    num_devs  = num_sensors * DHT22_DEVS_PER_SENSOR;
+    alloc_ret = alloc_chrdev_region(&dev, 0, num_devs, "dht22");
+    if (alloc_ret)
+        goto error;
+
+    device_major = MAJOR(dev);
+    cdev_init(&dht22_cdev, &dht22_fops);
+    dht22_cdev.owner = THIS_MODULE;
+    dht22_cdev.ops  = &dht22_fops;
+
+    cdev_err = cdev_add(&dht22_cdev, MKDEV(device_major, 0), num_devs);
+    if (cdev_err)
+        goto error;
+
+    /* 
+     * create class first, and device files associated to this class
+     */
+    dht22_class = class_create(THIS_MODULE, "dht22");
+    if (IS_ERR(dht22_class))
+        goto error;
+
+    /*
+     * must add a file to RPi '/etc/udev/rules.d/51-dht22.rules' 
+     * content:
+     * KERNEL="dht22:[0-9]*", GROUP="root", MODE="0444"
+     *
+     * NOET: the following 5th param is
+     * "dht22:%d", NOT "dht22%d"
+     */
+    for (i = 0; i < num_devs; ++i) {
+        int id   = i / DHT22_DEVS_PER_SENSOR;
+        int kind = i % DHT22_DEVS_PER_SENSOR;
+
+        if (DHT22_DEV_HISTORY == kind)
+            device_create(dht22_class, NULL, MKDEV(device_major, i), NULL,
+                          "dht22_history:%d", id);
+        else if (DHT22_DEV_READING == kind)
+            device_create(dht22_class, NULL, MKDEV(device_major, i), NULL,
+                          "dht22_reading:%d", id);
+        else
+            device_create(dht22_class, NULL, MKDEV(device_major, i), NULL,
+                          "dht22:%d", id * 2 + kind);
+    }
+    
+    pr_err("dht22 driver (major %d) installed\n", device_major);
+    return 0;
+
+error:
+    if (cdev_err == 0)
+        cdev_del(&dht22_cdev);
+    if (0 == alloc_ret)
+        unregister_chrdev_region(dev, num_devs);
+
+    return -1;    
+}
+
+static void dht22_dev_exit(void)
+{
+    dev_t   dev = MKDEV(device_major, 0);
+    int     i;
+
+    for (i = 0; i < num_devs; ++i)
+        device_destroy(dht22_class, MKDEV(device_major, i));
+    class_destroy(dht22_class);
+    cdev_del(&dht22_cdev);
+    unregister_chrdev_region(dev, num_devs);
+}
+
+static int dev_open(struct inode* inode, struct file* file)
+{
+    int                 minor = iminor(inode);
+    struct dht22_file*  df;
+
+    if (dbg_flag) {
+        pr_info("dht22:%s major %d, minor %d (pid %d)\n", __func__,
+                                                         imajor(inode),
+                                                         minor,
+                                                         current->pid);
+    }
+
+    if (minor >= num_devs)
+        return -ENXIO;
+
+    switch (minor % DHT22_DEVS_PER_SENSOR) {
+        case DHT22_DEV_HUMIDITY:
+            file->f_op = &dht22_fops_h;
+            break;
+        case DHT22_DEV_TEMPERATURE:
+            file->f_op = &dht22_fops_t;
+            break;
+        case DHT22_DEV_HISTORY:
+            file->f_op = &dht22_fops_history;
+            break;
+        case DHT22_DEV_READING:
+            file->f_op = &dht22_fops_r;
+            break;
+        default:
+            return -ENXIO;
+    }
+
+    df = kzalloc(sizeof(*df), GFP_KERNEL);
+    if (NULL == df)
+        return -ENOMEM;
+
+    /* poll() reports readings newer than the time of open() */
+    df->sensor     = sensors[minor / DHT22_DEVS_PER_SENSOR];
+    df->seen       = get_reading_seq(df->sensor);
+    df->max_age_ms = READ_ONCE(df->sensor->max_age_ms);
+    consumer_get(df->sensor);
+
+    file->private_data = df;
+    if (file->f_op && file->f_op->open)
+        return file->f_op->open(inode, file);
+
+    return 0;
+}
+
+static int dev_open_h(struct inode* inode, struct file* file)
+{
+    return 0;
+}
+static int dev_open_t(struct inode* inode, struct file* file)
+{
+    return 0;
+}
+static int dev_open_r(struct inode* inode, struct file* file)
+{
+    return 0;
+}
+
+static int dev_close(struct inode* inode, struct file* file)
+{
+    struct dht22_file* df = file->private_data;
+
+    if (dbg_flag)
+        pr_info("dht22:%s\n", __func__);
+    consumer_put(df->sensor);
+    kfree(df);
+    return 0;
+}
+
+static ssize_t dev_read_h(struct file* file, char __user* buf, 
+                          size_t count, loff_t* f_pos)
+{
+    return read_data(file, buf, count, f_pos, DHT22_DEV_HUMIDITY);
+}
+
+static ssize_t dev_read_t(struct file* file, char __user* buf, 
+                          size_t count, loff_t* f_pos)
+{
+    return read_data(file, buf, count, f_pos, DHT22_DEV_TEMPERATURE);
+}
+
+static ssize_t dev_read_r(struct file* file, char __user* buf, 
+                          size_t count, loff_t* f_pos)
+{
+    return read_data(file, buf, count, f_pos, DHT22_DEV_READING);
+}
+
+/*
+ * lock-free snapshot of the latest reading of the sensor,
+ * humidity and temperature always come from the same conversion
+ */
+static void get_reading(struct dht22_sensor* sensor, struct dht22_record* rec)
+{
+    unsigned seq;
+
+    do {
+        seq  = read_seqcount_begin(&sensor->reading_seqcount);
+        *rec = sensor->reading;
+    } while (read_seqcount_retry(&sensor->reading_seqcount, seq));
+}
+
+/* u64 loads may tear on 32-bit CPUs, also under the seqcount */
+static u64 get_reading_seq(struct dht22_sensor* sensor)
+{
+    unsigned seq;
+    u64      reading_seq;
+
+    do {
+        seq         = read_seqcount_begin(&sensor->reading_seqcount);
+        reading_seq = sensor->reading.seq;
+    } while (read_seqcount_retry(&sensor->reading_seqcount, seq));
+
+    return reading_seq;
+}
+
+static u64 get_notified_seq(struct dht22_sensor* sensor)
+{
+    unsigned seq;
+    u64      notified_seq;
+
+    do {
+        seq          = read_seqcount_begin(&sensor->reading_seqcount);
+        notified_seq = sensor->notified.seq;
+    } while (read_seqcount_retry(&sensor->reading_seqcount, seq));
+
+    return notified_seq;
+}
+
+/*
+ * lock-free copy of one text form of the latest reading into 'buf'
+ * (at least DHT22_TEXT_MAX bytes), and the seq of that reading if
+ * 'reading_seq' isn't NULL; returns the length, no formatting at all
+ */
+static int get_text(struct dht22_sensor* sensor, enum dht22_text text,
+                    char* buf, u64* reading_seq)
+{
+    unsigned seq;
+    int      len;
+
+    do {
+        seq = read_seqcount_begin(&sensor->reading_seqcount);
+        len = sensor->texts.len[text];
+        memcpy(buf, sensor->texts.text[text], len);
+        if (reading_seq)
+            *reading_seq = sensor->reading.seq;
+    } while (read_seqcount_retry(&sensor->reading_seqcount, seq));
+
+    return len;
+}
+
+/*
+ * all text forms of 'reading', see enum dht22_text
+ */
+static void render_texts(struct dht22_texts* texts,
+                         const struct dht22_record* reading)
+{
+    char* buf;
+    int   len;
+
+    buf = texts->text[DHT22_TEXT_HUMIDITY];
+    len = sprint_tenths(buf, reading->humidity);
+    buf[len++] = '\n';
+    texts->len[DHT22_TEXT_HUMIDITY] = len;
+
+    buf = texts->text[DHT22_TEXT_TEMPERATURE];
+    len = sprint_tenths(buf, reading->temperature);
+    buf[len++] = '\n';
+    texts->len[DHT22_TEXT_TEMPERATURE] = len;
+
+    buf  = texts->text[DHT22_TEXT_READING];
+    len  = sprint_tenths(buf, reading->humidity);
+    buf[len++] = ' ';
+    len += sprint_tenths(buf + len, reading->temperature);
+    buf[len++] = '\n';
+    texts->len[DHT22_TEXT_READING] = len;
+
+    buf = texts->text[DHT22_TEXT_SYSFS_HUMIDITY];
+    len = sprint_tenths(buf, reading->humidity);
+    texts->len[DHT22_TEXT_SYSFS_HUMIDITY] = len + sprintf(buf + len, "%%\n");
+
+    buf = texts->text[DHT22_TEXT_SYSFS_TEMPERATURE];
+    len = sprint_tenths(buf, reading->temperature);
+    texts->len[DHT22_TEXT_SYSFS_TEMPERATURE] = len + sprintf(buf + len,
+                                                             "°C\n");
+}
+
+/*
+ * seqcount write side of 'reading' and its texts (and 'notified' if to
+ * 'notify'), and the mmap()-ed page if it's new;
+ * the texts are rendered before, outside of the write section
+ */
+static void publish_reading(struct dht22_sensor* sensor,
+                            const struct dht22_record* reading, bool notify)
+{
+    bool               is_new = reading->seq != sensor->reading.seq;
+    struct dht22_texts texts;
+
+    render_texts(&texts, reading);
+
+    preempt_disable();
+    write_seqcount_begin(&sensor->reading_seqcount);
+    sensor->reading = *reading;
+    sensor->texts   = texts;
+    if (notify)
+        sensor->notified = *reading;
+    write_seqcount_end(&sensor->reading_seqcount);
+    preempt_enable();
+
+    if (is_new) {
+        shm_publish(sensor, reading->timestamp_ns, reading->humidity,
+                    reading->temperature);
+    }
+}
+
+/*
+ * binary mode, one whole record per read() no matter the file position,
+ * so reads are repeatable on the same fd
+ */
+static ssize_t read_record(char __user* buf, size_t count,
+                           const struct dht22_record* rec)
+{
+    if (count < sizeof(*rec))
+        return -EINVAL;
+    if (copy_to_user(buf, rec, sizeof(*rec)))
+        return -EFAULT;
+    return sizeof(*rec);
+}
+
+static long dev_ioctl(struct file* file, unsigned int cmd, unsigned long arg)
+{
+    struct dht22_file* df = file->private_data;
+
+    switch (cmd) {
+        case DHT22_IOC_SET_MODE:
+            if (DHT22_MODE_TEXT != arg && DHT22_MODE_BINARY != arg)
+                return -EINVAL;
+            df->mode = arg;
+            return 0;
+        case DHT22_IOC_GET_MODE:
+            return put_user(df->mode, (int __user*)arg);
+        case DHT22_IOC_SET_MAX_AGE:
+            if (arg > INT_MAX)
+                return -EINVAL;
+            df->max_age_ms = arg;
+            return 0;
+        case DHT22_IOC_GET_MAX_AGE:
+            return put_user(df->max_age_ms, (int __user*)arg);
+        case DHT22_IOC_GET_STATS: {
+            struct dht22_stats stats;
+
+            get_stats(df->sensor, &stats);
+            if (copy_to_user((void __user*)arg, &stats, sizeof(stats)))
+                return -EFAULT;
+            return 0;
+        }
+        default:
+            return -ENOTTY;
+    }
+}
+
+/*
+ * readable once a notified reading newer than the last one read() by this
+ * file (or newer than open(), if never read) is available; readings within
+ * the deadband are returned by read() but don't make the file readable
+ */
+static unsigned int dev_poll(struct file* file, poll_table* wait)
+{
+    struct dht22_file*   df = file->private_data;
+    struct dht22_sensor* sensor = df->sensor;
+
+    poll_wait(file, &sensor->wait, wait);
+
+    return get_notified_seq(sensor) > df->seen ? POLLIN | POLLRDNORM : 0;
+}
+
+/*
+ * map the read-only page of latest reading, struct dht22_shm
+ */
+static int dev_mmap(struct file* file, struct vm_area_struct* vma)
+{
+    struct dht22_sensor* sensor = 
+                         ((struct dht22_file*)file->private_data)->sensor;
+
+    if (vma->vm_pgoff != 0 || vma->vm_end - vma->vm_start > PAGE_SIZE)
+        return -EINVAL;
+    if (vma->vm_flags & VM_WRITE)
+        return -EPERM;
+
+    vma->vm_flags &= ~VM_MAYWRITE;
+    vma->vm_flags |= VM_DONTEXPAND | VM_DONTDUMP;
+    return vm_insert_page(vma, vma->vm_start, virt_to_page(sensor->shm));
+}
+
+/*
+ * read latest reading in the mode of this file;
+ * a reading newer than the last one returned by this file
+ * starts over from the beginning, so one fd can read() after each poll()
+ *
+ * text mode: "<humidity>\n", "<temperature>\n" or
+ * "<humidity> <temperature>\n" by 'kind', as rendered by process_results();
+ * honors the file position, so short reads continue where the previous
+ * one stopped
+ */
+static ssize_t read_data(struct file* file, char __user* buf, size_t count, 
+                         loff_t* f_pos, enum dht22_dev_kind kind)
+{
+    static const enum dht22_text texts[DHT22_DEVS_PER_SENSOR] = {
+        [DHT22_DEV_HUMIDITY]    = DHT22_TEXT_HUMIDITY,
+        [DHT22_DEV_TEMPERATURE] = DHT22_TEXT_TEMPERATURE,
+        [DHT22_DEV_READING]     = DHT22_TEXT_READING,
+    };
+    struct dht22_file*    df = file->private_data;
+    struct dht22_record   rec;
+    char                  tmp[DHT22_TEXT_MAX];
+    int                   len = 0;
+    u64                   seq;
+    int                   ret;
+
+    ret = read_fresh(file);
+    if (ret)
+        return ret;
+
+    if (DHT22_MODE_BINARY == df->mode) {
+        get_reading(df->sensor, &rec);
+        seq = rec.seq;
+    }
+    else {
+        len = get_text(df->sensor, texts[kind], tmp, &seq);
+    }
+
+    if (seq != df->seen) {
+        df->seen = seq;
+        *f_pos   = 0;
+    }
+
+    if (DHT22_MODE_BINARY == df->mode)
+        return read_record(buf, count, &rec);
+
+    return simple_read_from_buffer(buf, count, f_pos, tmp, len);
+}
+
+/*
+ * with a max_age of the file, a reading older than that isn't returned
+ * right away: start a conversion, or join the one in progress, and sleep
+ * until it's done, good or not (it's the caller's to check 'status');
+ * O_NONBLOCK returns the cached reading as is
+ */
+static int read_fresh(struct file* file)
+{
+    struct dht22_file*   df = file->private_data;
+    struct dht22_sensor* sensor = df->sensor;
+    struct dht22_record  rec;
+    int                  done;
+
+    if (0 == df->max_age_ms || (file->f_flags & O_NONBLOCK))
+        return 0;
+
+    get_reading(sensor, &rec);
+    if (rec.seq && ktime_get_ns() - rec.timestamp_ns <=
+                   (u64)df->max_age_ms * NSEC_PER_MSEC)
+        return 0;
+
+    /*
+     * done_count before the state (pairs with transaction_done()):
+     * request_conversion() either sees dht22_idle and starts (or
+     * defers) a conversion, or sees one in progress, which moves
+     * done_count later, including a frame already in dht22_done
+     * waiting for process_results() (a reader after the last edge)
+     */
+    done = atomic_read(&sensor->done_count);
+    smp_rmb();
+    request_conversion(sensor);
+    return wait_event_interruptible(sensor->done_wait,
+                                    atomic_read(&sensor->done_count) != done);
+}
+
+/*
+ * raw values are 10 times of real ones, "-0.5" for -5
+ */
+static int sprint_tenths(char* buf, int data)
+{
+    return sprintf(buf, "%s%d.%d", (data < 0 && data > -10) ? "-" : "",
+                                   data/10, abs(data)%10);
+}
+
+/*
+ * file position of /dev/dht22_history:<n> is the sequence number of
+ * next record to read (not a byte offset); it starts from 0, the oldest
+ * record still in the ring is returned if the reader fell behind.
+ * one read() returns as many whole records as 'count' can hold,
+ * 0 if no new record yet.
+ */
+static ssize_t dev_read_history(struct file* file, char __user* buf,
+                                size_t count, loff_t* f_pos)
+{
+    struct dht22_sensor*    sensor = 
+                            ((struct dht22_file*)file->private_data)->sensor;
+    struct dht22_record     tmp[8];     /* bounce buffer, copied unlocked */
+    const size_t            size = sizeof(struct dht22_record);
+    u64                     seq = *f_pos;
+    ssize_t                 done = 0;
+
+    if (count < size)
+        return -EINVAL;
+
+    while (count - done >= size) {
+        u64 oldest;
+        u64 n;
+        u64 i;
+
+        spin_lock(&sensor->history_lock);
+        oldest = sensor->history_seq > DHT22_HISTORY_LEN ?
+                 sensor->history_seq - DHT22_HISTORY_LEN : 0;
+        if (seq < oldest)
+            seq = oldest;
+        n = min_t(u64, sensor->history_seq - seq, ARRAY_SIZE(tmp));
+        n = min_t(u64, n, (count - done) / size);
+        for (i = 0; i < n; ++i)
+            tmp[i] = sensor->history[(seq + i) % DHT22_HISTORY_LEN];
+        spin_unlock(&sensor->history_lock);
+
+        if (0 == n)
+            break;
+        if (copy_to_user(buf + done, tmp, n * size))
+            return done ? done : -EFAULT;
+
+        seq  += n;
+        done += n * size;
+        *f_pos = seq;
+    }
+
+    return done;
+}
+
+/*
+ * SEEK_SET/SEEK_CUR to resume from a given sequence number,
+ * SEEK_END relative to the next record to be produced
+ * (lseek(fd, 0, SEEK_END) skips all records already in the ring)
+ */
+static loff_t dev_llseek_history(struct file* file, loff_t offset, int whence)
+{
+    struct dht22_sensor*    sensor = 
+                            ((struct dht22_file*)file->private_data)->sensor;
+    loff_t                  pos;
+
+    switch (whence) {
+        case SEEK_SET:
+            pos = offset;
+            break;
+        case SEEK_CUR:
+            pos = file->f_pos + offset;
+            break;
+        case SEEK_END:
+            spin_lock(&sensor->history_lock);
+            pos = sensor->history_seq + offset;
+            spin_unlock(&sensor->history_lock);
+            break;
+        default:
+            return -EINVAL;
+    }
+
+    if (pos < 0)
+        return -EINVAL;
+
+    file->f_pos = pos;
+    return pos;
+}
+
+/*
+ * readable while records at or after the file position are in the ring
+ */
+static unsigned int dev_poll_history(struct file* file, poll_table* wait)
+{
+    struct dht22_sensor*    sensor = 
+                            ((struct dht22_file*)file->private_data)->sensor;
+    unsigned int            mask = 0;
+
+    poll_wait(file, &sensor->history_wait, wait);
+
+    spin_lock(&sensor->history_lock);
+    if (sensor->history_seq > (u64)file->f_pos)
+        mask = POLLIN | POLLRDNORM;
+    spin_unlock(&sensor->history_lock);
+
+    return mask;
+}
+
+static void dht22_timer_init(struct hrtimer* timer, 
+                             enum hrtimer_restart (*func)(struct hrtimer*),
+                             bool start_now,
+                             int  wait_sec)
+{
+    hrtimer_init(timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    timer->function = func;
+    if (start_now)
+        hrtimer_start(timer, ktime_set(wait_sec,0), HRTIMER_MODE_REL);
+}
+
+/*
+ * 'retry_level' is 0 for autoupdate or manual trigger,
+ * n for the n-th retry of a failed one
+ */
+static void to_trigger_dht22(struct dht22_sensor* sensor, int retry_level)
+{
+    if (READ_ONCE(sensor->dying))
+        return;
+
+    /*
+     * DHT22 working in progress, ignore this event;
+     * may race with the sysfs 'trigger', only one of them leaves idle
+     */
+    if (dht22_idle != cmpxchg(&sensor->state, dht22_idle, dht22_start)) {
+        trace_dht22_trigger(sensor->id, retry_level, sensor->capture_mode, true);
+        atomic_inc(&sensor->fail_busy);
+        return;
+    }
+
+    /* a new regular read supersedes a pending retry */
+    if (0 == retry_level)
+        hrtimer_try_to_cancel(&sensor->retry_timer);
+
+    sensor->retry_level   = retry_level;
+    ++sensor->retry_attempts[retry_level];
+    sensor->capture_mode  = READ_ONCE(sensor->capture);
+    ++sensor->capture_reads[sensor->capture_mode];
+    sensor->edge_count    = 0;
+    trace_dht22_trigger(sensor->id, retry_level, sensor->capture_mode, false);
+
+    /* the polled capture finishes by itself, in poll_capture() */
+    if (DHT22_CAPTURE_IRQ == sensor->capture_mode)
+        hrtimer_start(&sensor->timeout_timer,
+                      ktime_set(timeout_time, NSEC_PER_MSEC * timeout_time_ms),
+                      HRTIMER_MODE_REL);
+
+    trigger_dht22(sensor);
+    if (DHT22_CAPTURE_IRQ == sensor->capture_mode)
+        sensor->capture_cpu_ns[DHT22_CAPTURE_IRQ] += ktime_get_ns() -
+                                                     sensor->trigger_ns;
+}
+
+/*
+ * state machine of a transaction:
+ *
+ *   dht22_idle      -> dht22_start     to_trigger_dht22(), bus pulled LOW
+ *   dht22_start     -> dht22_response  start_func(), 1ms later, bus released
+ *   dht22_response  -> dht22_data      DHT22 responded (IRQ handler)
+ *   dht22_data      -> dht22_done      last bit received, frame queued
+ *                                      to process_results()
+ *   dht22_done      -> dht22_idle      process_results() decoded it
+ *   others          -> dht22_done      timeout_func(), 1.5 sec after
+ *                                      trigger, enough edges to decode
+ *                   -> dht22_idle      timeout_func(), too few edges
+ *
+ * dht22_idle is only entered through transaction_done(), which wakes up
+ * read_fresh(); a reader never waits for a transaction which already
+ * ended
+ *
+ * the IRQ handler ignores edges in any other state than start, response
+ * and data, so a stray edge never moves the state machine by itself
+ *
+ * for DHT22_CAPTURE_POLL, poll_capture() releases the bus and goes
+ * through response/data/done with interrupts disabled; then
+ * process_results() as above, or back to idle if too few edges.
+ * Nothing busy waits; the start pulse is timed by 'start_timer'
+ */
+static void trigger_dht22(struct dht22_sensor* sensor)
+{
+    sensor->trigger_ns   = ktime_get_ns();
+    sensor->prev_edge_ns = sensor->trigger_ns;
+    /*
+     * pull down bus at least 1ms
+     * to signal DHT22 for preparing humidity/temperature data
+     */
+    gpio_direction_output(sensor->gpio, low);
+    hrtimer_start(&sensor->start_timer, ktime_set(0, DHT22_START_PULSE_NS),
+                  HRTIMER_MODE_REL);
+}
+
+static enum hrtimer_restart start_func(struct hrtimer* hrtimer)
+{
+    struct dht22_sensor* sensor = container_of(hrtimer, struct dht22_sensor,
+                                               start_timer);
+
+    sensor->state = dht22_response;
+
+    /* may not poll for 5ms here, release the bus from process context */
+    if (DHT22_CAPTURE_POLL == sensor->capture_mode) {
+        queue_work(system_highpri_wq, &sensor->capture_work);
+        return HRTIMER_NORESTART;
+    }
+
+    /*
+     * release bus (bus return to HIGH, due to pull-up resistor)
+     * switch GPIO to input mode to receive data from DHT22
+     * let the interrupt handler to process the followings
+     */
+    gpio_direction_input(sensor->gpio);
+    trace_dht22_start_release(sensor->id, ktime_get_ns() - sensor->trigger_ns);
+    return HRTIMER_NORESTART;
+}
+
+/*
+ * DHT22_CAPTURE_POLL: release the bus at the end of the start pulse
+ * (queued by start_func()) and sample the line in a busy loop,
+ * with local interrupts and the GPIO's IRQ disabled, so that no edge is
+ * lost to IRQ latency; at the expense of ~5ms of one CPU per transaction.
+ * The edge log is the same as the IRQ handler's (without the edge of
+ * the start pulse), and decoded by the same process_results()
+ */
+static void poll_capture(struct work_struct* work)
+{
+    struct dht22_sensor* sensor = container_of(work, struct dht22_sensor,
+                                               capture_work);
+    unsigned long flags;
+    u64 start;
+    u64 deadline;
+    u64 now;
+    int prev;
+    int level;
+    int n = 0;
+
+    disable_irq(sensor->irq_number);
+    local_irq_save(flags);
+
+    start = ktime_get_ns();
+    gpio_direction_input(sensor->gpio);
+    deadline = start + DHT22_POLL_WINDOW_NS;
+    /* the line is LOW now, its rising edge is the end of the start pulse */
+    prev = low;
+    do {
+        now   = ktime_get_ns();
+        level = !!gpio_get_value(sensor->gpio);
+        if (level != prev) {
+            dht22_log_edge(sensor->edges, n, now - sensor->prev_edge_ns, level);
+            sensor->prev_edge_ns = now;
+            prev = level;
+            ++n;
+            /* bus released, DHT22 response LOW and HIGH */
+            if (3 == n)
+                sensor->state = dht22_data;
+        }
+        /* bus released by DHT22 after the last bit, longer than any HIGH */
+        else if (high == level && n >= DHT22_EDGES_MIN &&
+                 now - sensor->prev_edge_ns > 2 * DHT22_RESPONSE_MAX_NS)
+            break;
+    } while (now < deadline);
+
+    local_irq_restore(flags);
+    enable_irq(sensor->irq_number);
+    trace_dht22_start_release(sensor->id, start - sensor->trigger_ns);
+
+    /* not in the loop above, to keep the sampling rate when enabled */
+    if (trace_dht22_edge_enabled()) {
+        int i;
+
+        for (i = 0; i < n && i < DHT22_EDGES_MAX; ++i)
+            trace_dht22_edge(sensor->id, i, sensor->edges[i].level,
+                             sensor->edges[i].delta_ns);
+    }
+
+    sensor->capture_cpu_ns[DHT22_CAPTURE_POLL] += now - start;
+    sensor->edge_count = n;
+    ++sensor->dbg_total_read;
+    gpio_direction_output(sensor->gpio, high);
+
+    /*
+     * the log stays the sensor's until process_results() has taken it:
+     * still dht22_done, no trigger may overwrite it meanwhile
+     */
+    if (n >= DHT22_EDGES_MIN) {
+        sensor->state = dht22_done;
+        queue_results(sensor, ktime_get_ns());
+    }
+    else {
+        trace_dht22_timeout(sensor->id, n);
+        if (dbg_flag)
+            pr_info("Failed to fetch DHT22 %d data\n", sensor->id);
+        ++sensor->dbg_fail_read;
+        atomic_inc(&sensor->fail_timeout);
+        schedule_retry(sensor);
+        transaction_done(sensor);
+    }
+
+    if (dbg_flag)
+        pr_info("DHT22 %d polled %d edges in %lluus\n", sensor->id, n,
+                div_u64(now - start, NSEC_PER_USEC));
+}
+
+static enum hrtimer_restart timeout_func(struct hrtimer* hrtimer)
+{
+    struct dht22_sensor* sensor = container_of(hrtimer, struct dht22_sensor,
+                                               timeout_timer);
+    enum dht22_state     state;
+
+    ++sensor->dbg_total_read;
+    /* pull high, and wait for next trigger */
+    gpio_direction_output(sensor->gpio, high);
+
+    /*
+     * in dht22_done, the frame is queued already (85 interrupts) and
+     * process_results() ends the transaction
+     */
+    state = READ_ONCE(sensor->state);
+    if (dht22_idle != state && dht22_done != state) {
+        /*
+         * host receive fewer than 85 interrupts;
+         * some lost, dht22_decode_edges() may still repair the frame,
+         * or too many lost and no results were produced;
+         * back to 'dht22_idle' and wait for next trigger (if autoupdate)
+         */
+        if (sensor->edge_count >= DHT22_EDGES_MIN) {
+            sensor->state = dht22_done;
+            queue_results(sensor, ktime_get_ns());
+        }
+        else {
+            trace_dht22_timeout(sensor->id, sensor->edge_count);
+            if (dbg_flag)
+                pr_info("Failed to fetch DHT22 %d data\n", sensor->id);
+            ++sensor->dbg_fail_read;
+            atomic_inc(&sensor->fail_timeout);
+            schedule_retry(sensor);
+            transaction_done(sensor);
+        }
+    }
+    if (dbg_flag) {
+        pr_info("DHT22 %d total read %d, fail %d\n", sensor->id,
+                                                     sensor->dbg_total_read,
+                                                     sensor->dbg_fail_read);
+        pr_info("last IRQ count (should be 85) %d\n", sensor->edge_count);
+    }
+    return HRTIMER_NORESTART;
+}
+
+/*
+ * a conversion for fresh readers: none if one is in progress already,
+ * all of them share it; deferred by fresh_timer until DHT22's minimal
+ * interval after the previous trigger, or the warming up after loading
+ */
+static void request_conversion(struct dht22_sensor* sensor)
+{
+    u64 since;
+
+    if (READ_ONCE(sensor->dying) || dht22_idle != READ_ONCE(sensor->state))
+        return;
+
+    since = ktime_get_ns() - READ_ONCE(sensor->trigger_ns);
+    if (since >= DHT22_MIN_INTERVAL_SEC * NSEC_PER_SEC)
+        to_trigger_dht22(sensor, 0);
+    else if (!hrtimer_active(&sensor->fresh_timer))
+        hrtimer_start(&sensor->fresh_timer,
+                      ns_to_ktime(DHT22_MIN_INTERVAL_SEC * NSEC_PER_SEC -
+                                  since),
+                      HRTIMER_MODE_REL);
+}
+
+/*
+ * an autoupdate, retry or 'trigger' may have come since fresh_timer was
+ * armed: join the conversion in progress, or wait for the rest of the
+ * minimal interval after it
+ */
+static enum hrtimer_restart fresh_func(struct hrtimer* hrtimer)
+{
+    struct dht22_sensor* sensor = container_of(hrtimer, struct dht22_sensor,
+                                               fresh_timer);
+    u64 since;
+
+    if (READ_ONCE(sensor->dying) || dht22_idle != READ_ONCE(sensor->state))
+        return HRTIMER_NORESTART;
+
+    since = ktime_get_ns() - READ_ONCE(sensor->trigger_ns);
+    if (since < DHT22_MIN_INTERVAL_SEC * NSEC_PER_SEC) {
+        hrtimer_forward_now(hrtimer,
+                            ns_to_ktime(DHT22_MIN_INTERVAL_SEC * NSEC_PER_SEC -
+                                        since));
+        return HRTIMER_RESTART;
+    }
+
+    to_trigger_dht22(sensor, 0);
+    return HRTIMER_NORESTART;
+}
+
+/*
+ * end of a transaction, good or not: back to idle, then wake up
+ * read_fresh(); the only way back to dht22_idle once triggered.
+ * idle is visible before done_count moves, see read_fresh()
+ */
+static void transaction_done(struct dht22_sensor* sensor)
+{
+    WRITE_ONCE(sensor->state, dht22_idle);
+    smp_mb__before_atomic();
+    atomic_inc(&sensor->done_count);
+    wake_up_interruptible(&sensor->done_wait);
+}
+
+static enum hrtimer_restart autoupdate_func(struct hrtimer *hrtimer)
+{
+    struct dht22_sensor* sensor = container_of(hrtimer, struct dht22_sensor,
+                                               autoupdate_timer);
+
+    if (READ_ONCE(sensor->dying))
+        return HRTIMER_NORESTART;
+
+    /*
+     * nobody reads this sensor, stop the timer until consumer_seen();
+     * 'paused' is set before checking once more, a consumer showing up
+     * meanwhile either sees it or is seen here
+     */
+    if (autoupdate_idle(sensor)) {
+        WRITE_ONCE(sensor->paused, true);
+        smp_mb();
+        if (autoupdate_idle(sensor) || !xchg(&sensor->paused, false)) {
+            if (dbg_flag)
+                pr_info("DHT22 %d autoupdate paused\n", sensor->id);
+            return HRTIMER_NORESTART;
+        }
+    }
+
+    if (sensor->autoupdate)
+        to_trigger_dht22(sensor, 0);
+
+    /*
+     * only trigger DHT22 when 'autoupdate' is enabled
+     * so keep the timerr continue flying
+     */ 
+    if (DHT22_SCHEDULE_RELATIVE == READ_ONCE(sensor->schedule))
+        hrtimer_forward(hrtimer, ktime_get(), 
+                        ktime_set(autoupdate_period(sensor), 0));
+    else
+        hrtimer_set_expires(hrtimer, autoupdate_next(sensor));
+    hrtimer_set_expires_range_ns(hrtimer, hrtimer_get_expires(hrtimer),
+                                 (u64)READ_ONCE(sensor->slack_us) *
+                                 NSEC_PER_USEC);
+    return HRTIMER_RESTART;
+}
+
+/*
+ * no consumer for idle_sec: no open file, IIO buffer or netlink
+ * subscriber, no sysfs read
+ */
+static bool autoupdate_idle(struct dht22_sensor* sensor)
+{
+    int idle = READ_ONCE(sensor->idle_sec);
+
+    return idle > 0 && 0 == atomic_read(&sensor->consumers) &&
+           time_after(jiffies, READ_ONCE(sensor->last_active) +
+                               (unsigned long)idle * HZ) &&
+           !dht22_genl_listening();
+}
+
+/*
+ * a long-lived consumer: open file or enabled IIO buffer
+ */
+static void consumer_get(struct dht22_sensor* sensor)
+{
+    atomic_inc(&sensor->consumers);
+    consumer_seen(sensor);
+}
+
+/* the idle period starts when the last one is gone */
+static void consumer_put(struct dht22_sensor* sensor)
+{
+    WRITE_ONCE(sensor->last_active, jiffies);
+    smp_mb__before_atomic();
+    atomic_dec(&sensor->consumers);
+}
+
+/*
+ * someone reads the sensor; if autoupdate was paused, restart it and
+ * get a new reading right away, or as soon as DHT22's minimal interval
+ * since the previous conversion allows (see request_conversion())
+ */
+static void consumer_seen(struct dht22_sensor* sensor)
+{
+    WRITE_ONCE(sensor->last_active, jiffies);
+    smp_mb();
+    if (READ_ONCE(sensor->paused) && xchg(&sensor->paused, false)) {
+        if (dbg_flag)
+            pr_info("DHT22 %d autoupdate resumed\n", sensor->id);
+        autoupdate_restart(sensor);
+        request_conversion(sensor);
+    }
+}
+
+/*
+ * seconds between two autoupdate triggers, autoupdate_sec or the
+ * adaptive interval
+ */
+static int autoupdate_period(struct dht22_sensor* sensor)
+{
+    return READ_ONCE(sensor->adaptive) ? READ_ONCE(sensor->interval_sec) :
+                                         READ_ONCE(sensor->autoupdate_sec);
+}
+
+/*
+ * next autoupdate trigger, on CLOCK_MONOTONIC of autoupdate_timer:
+ * one period (see autoupdate_period()) from now for
+ * DHT22_SCHEDULE_RELATIVE; otherwise the first multiple of the period
+ * (plus phase_ms) of the clock of the schedule after now: the same
+ * instant on every NTP-synced host for CLOCK_REALTIME, but only within
+ * this host (all its sensors) for CLOCK_MONOTONIC, which starts at boot.
+ * a CLOCK_REALTIME schedule follows a clock change from the next trigger
+ */
+static ktime_t autoupdate_next(struct dht22_sensor* sensor)
+{
+    int     sched  = READ_ONCE(sensor->schedule);
+    u64     period = (u64)autoupdate_period(sensor) * NSEC_PER_SEC;
+    ktime_t mono   = ktime_get();
+    u64     now    = ktime_to_ns(mono);
+    u64     phase;
+    u64     next;
+
+    if (DHT22_SCHEDULE_RELATIVE == sched)
+        return ktime_add_ns(mono, period);
+    if (DHT22_SCHEDULE_REALTIME == sched)
+        now = ktime_to_ns(ktime_mono_to_real(mono));
+
+    div64_u64_rem((u64)READ_ONCE(sensor->phase_ms) * NSEC_PER_MSEC, period,
+                  &phase);
+    next = div64_u64(now + period - phase, period) * period + phase;
+    return ktime_add_ns(mono, next - now);
+}
+
+/*
+ * adaptive autoupdate, from each good reading: back to the minimal
+ * interval as soon as humidity or temperature changed faster than
+ * adaptive_rate since the previous good reading, otherwise double the
+ * interval up to the maximal one; a change of 0.1 is DHT22's noise.
+ * a new interval is applied right away, rather than from the next trigger
+ */
+static void adaptive_update(struct dht22_sensor* sensor,
+                            const struct dht22_record* prev,
+                            const struct dht22_record* reading)
+{
+    const int   diff[2] = { abs(reading->humidity    - prev->humidity),
+                            abs(reading->temperature - prev->temperature) };
+    u64         dt = reading->timestamp_ns - prev->timestamp_ns;
+    int         lo = READ_ONCE(sensor->adaptive_sec[0]);
+    int         hi = READ_ONCE(sensor->adaptive_sec[1]);
+    bool        fast = false;
+    int         interval;
+    int         q;
+
+    if (!READ_ONCE(sensor->adaptive) || 0 == prev->seq)
+        return;
+
+    /* diff / dt > rate per minute */
+    for (q = 0; q < 2; ++q) {
+        if (diff[q] > 1 && (u64)diff[q] * 60 * NSEC_PER_SEC >
+                           (u64)READ_ONCE(sensor->adaptive_rate[q]) * dt)
+            fast = true;
+    }
+
+    interval = fast ? lo : clamp(sensor->interval_sec * 2, lo, hi);
+    if (interval != sensor->interval_sec) {
+        WRITE_ONCE(sensor->interval_sec, interval);
+        autoupdate_restart(sensor);
+    }
+}
+
+/*
+ * reprogram autoupdate_timer after a change of its schedule, so the
+ * change takes effect now instead of after the current period;
+ * not while paused, consumer_seen() restarts it with the new schedule.
+ * 'paused' is checked after the cancel, autoupdate_func() may be
+ * pausing right now
+ */
+static void autoupdate_restart(struct dht22_sensor* sensor)
+{
+    mutex_lock(&sensor->autoupdate_lock);
+    if (sensor->dying) {
+        mutex_unlock(&sensor->autoupdate_lock);
+        return;
+    }
+    hrtimer_cancel(&sensor->autoupdate_timer);
+    if (READ_ONCE(sensor->paused)) {
+        mutex_unlock(&sensor->autoupdate_lock);
+        return;
+    }
+    hrtimer_start_range_ns(&sensor->autoupdate_timer, autoupdate_next(sensor),
+                           (u64)READ_ONCE(sensor->slack_us) * NSEC_PER_USEC,
+                           HRTIMER_MODE_ABS);
+    mutex_unlock(&sensor->autoupdate_lock);
+}
+
+/*
+ * retry a failed read after DHT22's minimal interval, doubled for each
+ * further failure, unless the next autoupdate trigger comes first anyway;
+ * none comes while autoupdate is paused
+ */
+static void schedule_retry(struct dht22_sensor* sensor)
+{
+    int     level = sensor->retry_level;
+    ktime_t delay;
+
+    if (READ_ONCE(sensor->dying) || level >= READ_ONCE(sensor->retries))
+        return;
+
+    delay = ktime_set(min(DHT22_MIN_INTERVAL_SEC << level,
+                          DHT22_RETRY_MAX_SEC), 0);
+    if (sensor->autoupdate && !READ_ONCE(sensor->paused) &&
+        ktime_compare(ktime_add(delay, ktime_set(DHT22_MIN_INTERVAL_SEC, 0)),
+                      hrtimer_get_remaining(&sensor->autoupdate_timer)) > 0)
+        return;
+
+    hrtimer_start(&sensor->retry_timer, delay, HRTIMER_MODE_REL);
+}
+
+static enum hrtimer_restart retry_func(struct hrtimer* hrtimer)
+{
+    struct dht22_sensor* sensor = container_of(hrtimer, struct dht22_sensor,
+                                               retry_timer);
+
+    to_trigger_dht22(sensor, sensor->retry_level + 1);
+    return HRTIMER_NORESTART;
+}
+
+/*
+ * decode the edge log in process context, 'now' is when it's complete
+ */
+static void queue_results(struct dht22_sensor* sensor, u64 now)
+{
+    sensor->queued_ns = now;
+    trace_dht22_frame_complete(sensor->id, sensor->edge_count);
+    queue_work(system_highpri_wq, &sensor->process_work);
+}
+
+static void process_results(struct work_struct* work)
+{
+    struct dht22_sensor* sensor = container_of(work, struct dht22_sensor,
+                                               process_work);
+    u8  data[5] = { 0 }; /* 2-byte humidity, 2-byte temperature, 1-byte CRC */
+    int raw_humidity;
+    int raw_temp;
+    u64 now = ktime_get_ns();
+    struct dht22_record reading;
+    struct dht22_decode_info info;
+    int count;
+    int ret;
+
+    /*
+     * keep a copy of the edge log for debugfs, and decode from the copy;
+     * the IRQ handler may still be appending the final edge
+     */
+    count = min(READ_ONCE(sensor->edge_count), DHT22_EDGES_MAX);
+    mutex_lock(&sensor->last_edges_lock);
+    memcpy(sensor->last_edges, sensor->edges, count * sizeof(struct dht22_edge));
+    sensor->last_edge_count = count;
+    sensor->last_edges_ns   = now;
+    mutex_unlock(&sensor->last_edges_lock);
+
+    /*
+     * the frame is ours: timeout_func() has nothing left to do (the bus
+     * stays released, pulled up, until the next trigger); the state
+     * stays dht22_done until transaction_done() below
+     */
+    hrtimer_cancel(&sensor->timeout_timer);
+
+    ret = dht22_decode_edges(sensor->last_edges, count, data, &info);
+    hist_add(&sensor->hist_wq_delay, now - READ_ONCE(sensor->queued_ns));
+    hist_add(&sensor->hist_latency,  now - sensor->trigger_ns);
+
+    raw_humidity = (data[0] << 8) | data[1];
+    raw_temp     = (data[2] << 8) | data[3];
+
+    /* be aware of temperature below 0°C, sign bit is not 2's complement */
+    if (data[2] & 0x80)
+        raw_temp = -(raw_temp & 0x7FFF);
+
+    trace_dht22_decode(sensor->id, data, ret, info.bits, info.repaired,
+                       raw_humidity, raw_temp);
+
+    if (dbg_flag) {
+        pr_info("DHT22 %d humidity    = %d.%d\n", sensor->id,
+                                                   raw_humidity/10,
+                                                   raw_humidity%10);
+        pr_info("DHT22 %d temperature = %d.%d\n", sensor->id,
+                                                   raw_temp/10,
+                                                   abs(raw_temp)%10);
+        pr_info("DHT22 raw data 0x%02X 0x%02X 0x%02X 0x%02X 0x%02X",
+                data[0], data[1], data[2], data[3], data[4]);
+        pr_info("DHT22 %d edges, %d bits, %d repaired, %d candidates, "
+                "LOW %uns, threshold %uns\n", count, info.bits, info.repaired,
+                info.candidates, info.low_ns, info.threshold_ns);
+    }
+
+    reading = sensor->reading;
+    if (0 == ret) {
+        bool notify;
+
+        history_add(sensor, now, raw_humidity, raw_temp, DHT22_STATUS_OK);
+        stats_add(sensor, now, raw_humidity, raw_temp);
+        reading.seq         += 1;
+        reading.timestamp_ns = now;
+        reading.humidity     = raw_humidity;
+        reading.temperature  = raw_temp;
+        reading.status       = DHT22_STATUS_OK;
+        notify = notify_due(sensor, &reading);
+        adaptive_update(sensor, &sensor->reading, &reading);
+        publish_reading(sensor, &reading, notify);
+        /*
+         * notify all user processes which called poll() to fetch
+         * humidity and/or temperature of this sensor, unless the change
+         * is within the deadband; the value is updated either way
+         * user space benchmark of readers: poll.c
+         */
+        if (notify) {
+            sysfs_notify(&sensor->kobj, NULL, "humidity");
+            sysfs_notify(&sensor->kobj, NULL, "temperature");
+            sysfs_notify(&sensor->kobj, NULL, "reading");
+            wake_up_interruptible(&sensor->wait);
+        }
+        dht22_iio_push(sensor);
+        ++sensor->retry_successes[sensor->retry_level];
+        ++sensor->capture_successes[sensor->capture_mode];
+        if (0 == info.repaired)
+            hist_add_high(sensor, count);
+        if (dbg_flag)
+            pr_info("CRC: OK\n");
+    }
+    else {
+        u32 status = -ENODATA == ret ? DHT22_STATUS_INCOMPLETE :
+                                       DHT22_STATUS_CRC_ERROR;
+
+        history_add(sensor, now, raw_humidity, raw_temp, status);
+        reading.status = status;
+        publish_reading(sensor, &reading, false);
+        atomic_inc(-ENODATA == ret ? &sensor->fail_edges : &sensor->fail_crc);
+        schedule_retry(sensor);
+        if (dbg_flag)
+            pr_info("CRC: Error\n");
+    }
+
+    /* /dev/dht22_history:<n> pollers, a record is added either way */
+    wake_up_interruptible(&sensor->history_wait);
+    dht22_genl_send(sensor, &reading);
+    transaction_done(sensor);
+}
+
+/*
+ * a good reading is notified if it's the first one, if humidity or
+ * temperature moved by its deadband or more since the last notified one
+ * (a deadband of 0 notifies every reading), or after heartbeat_sec
+ * without any notification
+ */
+static bool notify_due(struct dht22_sensor* sensor,
+                       const struct dht22_record* reading)
+{
+    const struct dht22_record* last = &sensor->notified;
+    int                        heartbeat = READ_ONCE(sensor->heartbeat_sec);
+
+    if (0 == last->seq)
+        return true;
+    if (abs(reading->humidity - last->humidity) >=
+        READ_ONCE(sensor->deadband[0]))
+        return true;
+    if (abs(reading->temperature - last->temperature) >=
+        READ_ONCE(sensor->deadband[1]))
+        return true;
+
+    return heartbeat > 0 &&
+           reading->timestamp_ns - last->timestamp_ns >=
+           (u64)heartbeat * NSEC_PER_SEC;
+}
+
+/*
+ * HIGH pulses of the data bits, from a frame decoded without repair:
+ * each falling edge ends one
+ */
+static void hist_add_high(struct dht22_sensor* sensor, int count)
+{
+    int i = dht22_find_data_start(sensor->last_edges, count);
+
+    for (; i >= 0 && i < count; ++i) {
+        if (0 == sensor->last_edges[i].level)
+            hist_add(&sensor->hist_high, sensor->last_edges[i].delta_ns);
+    }
+}
+
+/*
+ * append one record to the ring, overwriting the oldest one if full
+ */
+static void history_add(struct dht22_sensor* sensor, u64 timestamp_ns,
+                        int humidity, int temperature, u32 status)
+{
+    struct dht22_record* rec;
+
+    spin_lock(&sensor->history_lock);
+    rec = &sensor->history[sensor->history_seq % DHT22_HISTORY_LEN];
+    rec->seq          = sensor->history_seq++;
+    rec->timestamp_ns = timestamp_ns;
+    rec->humidity     = humidity;
+    rec->temperature  = temperature;
+    rec->status       = status;
+    rec->reserved     = 0;
+    spin_unlock(&sensor->history_lock);
+}
+
+/*
+ * seqcount write side of the mmap()-ed page;
+ * process_results() is the only writer of a sensor, no lock needed
+ * (the page is user visible, so a plain u32 instead of seqcount_t)
+ */
+static void shm_publish(struct dht22_sensor* sensor, u64 timestamp_ns,
+                        int humidity, int temperature)
+{
+    struct dht22_shm* shm = sensor->shm;
+
+    WRITE_ONCE(shm->seq, shm->seq + 1);
+    smp_wmb();
+    shm->count       += 1;
+    shm->timestamp_ns = timestamp_ns;
+    shm->humidity     = humidity;
+    shm->temperature  = temperature;
+    smp_wmb();
+    WRITE_ONCE(shm->seq, shm->seq + 1);
+}
+
+/*
+ * default windows and alpha, nothing accumulated yet
+ */
+static void stats_init(struct dht22_sensor* sensor)
+{
+    int w;
+
+    mutex_init(&sensor->stats_lock);
+    seqcount_init(&sensor->stats_seqcount);
+    sensor->ewma_alpha = DEFAULT_EWMA_ALPHA;
+    for (w = 0; w < DHT22_STATS_WINDOWS; ++w) {
+        sensor->windows[w].window_sec = default_windows[w];
+        sensor->windows[w].bucket_ns  = div_u64((u64)default_windows[w] *
+                                                NSEC_PER_SEC,
+                                                DHT22_STATS_BUCKETS);
+    }
+}
+
+/*
+ * fold one good reading into the bucket of 'timestamp_ns' of each window
+ * and into the EWMA, then publish the new summary; O(DHT22_STATS_BUCKETS)
+ * per window and reading, no matter how many readings a window holds
+ */
+static void stats_add(struct dht22_sensor* sensor, u64 timestamp_ns,
+                      int humidity, int temperature)
+{
+    const int   values[2] = { humidity, temperature };
+    int         w;
+    int         q;
+
+    mutex_lock(&sensor->stats_lock);
+    for (w = 0; w < DHT22_STATS_WINDOWS; ++w) {
+        struct dht22_window*      win = &sensor->windows[w];
+        struct dht22_stat_bucket* b;
+        u64                       epoch;
+        u32                       slot;
+
+        epoch = div64_u64(timestamp_ns, win->bucket_ns);
+        div_u64_rem(epoch, DHT22_STATS_BUCKETS, &slot);
+        b = &win->bucket[slot];
+        if (b->epoch != epoch) {
+            memset(b, 0, sizeof(*b));
+            b->epoch = epoch;
+        }
+
+        for (q = 0; q < 2; ++q) {
+            struct dht22_stat_acc* acc = &b->acc[q];
+
+            if (0 == b->count || values[q] < acc->min)
+                acc->min = values[q];
+            if (0 == b->count || values[q] > acc->max)
+                acc->max = values[q];
+            acc->sum   += values[q];
+            acc->sumsq += (s64)values[q] * values[q];
+        }
+        ++b->count;
+    }
+
+    for (q = 0; q < 2; ++q) {
+        s64 x = (s64)values[q] << DHT22_EWMA_SHIFT;
+
+        if (0 == sensor->stats.count)
+            sensor->ewma[q] = x;
+        else
+            sensor->ewma[q] += div_s64((x - sensor->ewma[q]) *
+                                       sensor->ewma_alpha, 1000);
+    }
+
+    stats_publish(sensor, timestamp_ns, sensor->stats.count + 1);
+    mutex_unlock(&sensor->stats_lock);
+}
+
+/*
+ * min/max/mean/stddev of one quantity from the sum of its samples
+ */
+static void stat_summary(struct dht22_stat* stat,
+                         const struct dht22_stat_acc* acc, u32 count)
+{
+    u64 var;
+
+    if (0 == count) {
+        memset(stat, 0, sizeof(*stat));
+        return;
+    }
+
+    stat->min  = acc->min;
+    stat->max  = acc->max;
+    stat->mean = div_s64(acc->sum >= 0 ? acc->sum + count / 2 :
+                                         acc->sum - count / 2, count);
+    /* n * sum(x^2) - sum(x)^2 >= 0, in 0.1^2 units before / n^2 */
+    var = acc->sumsq * count - (u64)(acc->sum * acc->sum);
+    stat->stddev = int_sqrt(div64_u64(var, (u64)count * count));
+}
+
+/*
+ * summarize the buckets of each window still within 'window_sec' of the
+ * latest reading at 'timestamp_ns', the 'count'-th one, and publish it
+ * along with the EWMA; caller holds stats_lock
+ */
+static void stats_publish(struct dht22_sensor* sensor, u64 timestamp_ns,
+                          u64 count)
+{
+    struct dht22_stats  stats = { 0 };
+    int                 w;
+    int                 i;
+    int                 q;
+
+    for (w = 0; w < DHT22_STATS_WINDOWS; ++w) {
+        const struct dht22_window* win = &sensor->windows[w];
+        struct dht22_window_stats* ws = &stats.window[w];
+        struct dht22_stat_acc      acc[2] = { { 0 } };
+        u64                        now;
+        u32                        n = 0;
+
+        now = div64_u64(timestamp_ns, win->bucket_ns);
+        for (i = 0; i < DHT22_STATS_BUCKETS; ++i) {
+            const struct dht22_stat_bucket* b = &win->bucket[i];
+
+            if (0 == b->count || b->epoch + DHT22_STATS_BUCKETS <= now)
+                continue;
+            for (q = 0; q < 2; ++q) {
+                if (0 == n || b->acc[q].min < acc[q].min)
+                    acc[q].min = b->acc[q].min;
+                if (0 == n || b->acc[q].max > acc[q].max)
+                    acc[q].max = b->acc[q].max;
+                acc[q].sum   += b->acc[q].sum;
+                acc[q].sumsq += b->acc[q].sumsq;
+            }
+            n += b->count;
+        }
+
+        ws->window_sec = win->window_sec;
+        ws->count      = n;
+        stat_summary(&ws->humidity,    &acc[0], n);
+        stat_summary(&ws->temperature, &acc[1], n);
+    }
+
+    stats.count        = count;
+    stats.timestamp_ns = timestamp_ns;
+
+    stats.ewma_humidity    = (sensor->ewma[0] +
+                              (1 << (DHT22_EWMA_SHIFT - 1))) >> DHT22_EWMA_SHIFT;
+    stats.ewma_temperature = (sensor->ewma[1] +
+                              (1 << (DHT22_EWMA_SHIFT - 1))) >> DHT22_EWMA_SHIFT;
+    stats.ewma_alpha       = sensor->ewma_alpha;
+
+    preempt_disable();
+    write_seqcount_begin(&sensor->stats_seqcount);
+    sensor->stats = stats;
+    write_seqcount_end(&sensor->stats_seqcount);
+    preempt_enable();
+}
+
+/*
+ * lock-free snapshot of the published statistics
+ */
+static void get_stats(struct dht22_sensor* sensor, struct dht22_stats* stats)
+{
+    unsigned seq;
+
+    do {
+        seq    = read_seqcount_begin(&sensor->stats_seqcount);
+        *stats = sensor->stats;
+    } while (read_seqcount_retry(&sensor->stats_seqcount, seq));
+}
+
+static irqreturn_t dht22_irq_handler(int irq, void* data)
+{
+    struct dht22_sensor* sensor = data;
+    u64                  now = ktime_get_ns();
+    u64                  delta = now - sensor->prev_edge_ns;
+    int                  n = sensor->edge_count;
+    int                  level;
+
+    /* edge latched while poll_capture() had the IRQ disabled */
+    if (DHT22_CAPTURE_IRQ != sensor->capture_mode)
+        return IRQ_HANDLED;
+
+    /*
+     * stray edge outside a transaction, or after its frame was queued:
+     * not logged, and the state is left to to_trigger_dht22() and
+     * timeout_func(), which is armed for each transaction
+     */
+    switch (READ_ONCE(sensor->state)) {
+    case dht22_start:
+    case dht22_response:
+    case dht22_data:
+        break;
+    default:
+        return IRQ_HANDLED;
+    }
+
+    /*
+     * to minimize IRQ CPU time, only log level and time since the
+     * previous edge; decode 40 bits later via work queue
+     */
+    level = !!gpio_get_value(sensor->gpio);
+    delta = dht22_log_edge(sensor->edges, n, delta, level);
+    trace_dht22_edge(sensor->id, n, level, delta);
+    sensor->prev_edge_ns = now;
+    sensor->edge_count   = ++n;
+
+    /* host LOW and release, DHT22 response LOW and HIGH */
+    if (4 == n)
+        sensor->state = dht22_data;
+
+    /*
+     * final falling edge (DHT22 final low) received, no more data;
+     * calculating 40 bits' value (0 or 1) via queue work
+     */
+    if (DHT22_EDGES - 1 == n) {
+        sensor->state = dht22_done;
+        queue_results(sensor, now);
+        if (dbg_flag)
+            pr_info("DHT22 %d received 85 interrupts\n", sensor->id);
+    }
+
+    delta = ktime_get_ns() - now;
+    sensor->capture_cpu_ns[DHT22_CAPTURE_IRQ] += delta;
+    hist_add(&sensor->hist_irq, delta);
+    return IRQ_HANDLED;
+}
+
+/*
+ * sysfs attributes
+ * the followings two declared in dht22.h
+ *
+ * (lazy macros)
+ *
+#define DECL_ATTR_SHOW(F)  ssize_t F ## _show (struct kobject* kobj,\
+                                               struct kobj_attribute* attr,\
+                                               char* buf)
+#define DECL_ATTR_STORE(F) ssize_t F ## _store(struct kobject* kobj,\
+                                               struct kobj_attribute* attr,\
+                                               const char* buf,\
+                                               size_t count)
+*/
+
+/* cat gpio */
+static DECL_ATTR_SHOW (gpio)
+{
+    return sprintf(buf, "%d\n", to_dht22_sensor(kobj)->gpio);
+}
+
+/* cat autoupdate */
+static DECL_ATTR_SHOW (autoupdate)
+{
+    return sprintf(buf, "%d\n", to_dht22_sensor(kobj)->autoupdate);
+}
+
+/* echo 1 > autoupdate */
+static DECL_ATTR_STORE(autoupdate)
+{
+    struct dht22_sensor* sensor = to_dht22_sensor(kobj);
+    int tmp;
+    int new_auto;
+
+    sscanf(buf, "%d\n", &tmp);
+    new_auto = 0 != tmp;
+
+    /*
+     * the autoupdate timer is still flying
+     * just update 'autoupdate' flag
+     */
+    if (new_auto != sensor->autoupdate)
+        sensor->autoupdate = new_auto;
+
+    if (dbg_flag)
+        pr_info("DHT22 %d autoupdate : %d\n", sensor->id, sensor->autoupdate);
+
+    return count;
+}
+
+/* cat autoupdate_sec */
+static DECL_ATTR_SHOW (autoupdate_sec)
+{
+    return sprintf(buf, "%d\n", to_dht22_sensor(kobj)->autoupdate_sec);
+}
+
+/* echo 10 > autoupdate_sec */
+static DECL_ATTR_STORE(autoupdate_sec)
+{
+    struct dht22_sensor* sensor = to_dht22_sensor(kobj);
+    int tmp;
+
+    sscanf(buf, "%d\n", &tmp);
+
+    if (tmp >= AUTOUPDATE_SEC_MIN && tmp <= AUTOUPDATE_SEC_MAX &&
+        tmp != sensor->autoupdate_sec) {
+        WRITE_ONCE(sensor->autoupdate_sec, tmp);
+        autoupdate_restart(sensor);
+    }
+
+    if (dbg_flag)
+        pr_info("DHT22 %d autoupdate duration %d sec\n", sensor->id,
+                                                         sensor->autoupdate_sec);
+
+    return count;
+}
+
+/* cat schedule */
+static DECL_ATTR_SHOW (schedule)
+{
+    return sprintf(buf, "%d\n", to_dht22_sensor(kobj)->schedule);
+}
+
+/*
+ * echo 2 > schedule
+ * 0 relative, 1 aligned to CLOCK_MONOTONIC, 2 aligned to CLOCK_REALTIME;
+ * takes effect now, as the following two
+ */
+static DECL_ATTR_STORE(schedule)
+{
+    struct dht22_sensor* sensor = to_dht22_sensor(kobj);
+    int tmp;
+
+    if (1 == sscanf(buf, "%d\n", &tmp) && tmp >= 0 && tmp < DHT22_SCHEDULES) {
+        WRITE_ONCE(sensor->schedule, tmp);
+        autoupdate_restart(sensor);
+    }
+
+    return count;
+}
+
+/* cat phase_ms */
+static DECL_ATTR_SHOW (phase_ms)
+{
+    return sprintf(buf, "%d\n", to_dht22_sensor(kobj)->phase_ms);
+}
+
+/* echo 2500 > phase_ms, modulo autoupdate_sec */
+static DECL_ATTR_STORE(phase_ms)
+{
+    struct dht22_sensor* sensor = to_dht22_sensor(kobj);
+    int tmp;
+
+    if (1 == sscanf(buf, "%d\n", &tmp) && tmp >= 0) {
+        WRITE_ONCE(sensor->phase_ms, tmp);
+        autoupdate_restart(sensor);
+    }
+
+    return count;
+}
+
+/* cat slack_us */
+static DECL_ATTR_SHOW (slack_us)
+{
+    return sprintf(buf, "%d\n", to_dht22_sensor(kobj)->slack_us);
+}
+
+/* echo 50000 > slack_us */
+static DECL_ATTR_STORE(slack_us)
+{
+    struct dht22_sensor* sensor = to_dht22_sensor(kobj);
+    int tmp;
+
+    if (1 == sscanf(buf, "%d\n", &tmp) && tmp >= 0 && tmp <= SLACK_US_MAX) {
+        WRITE_ONCE(sensor->slack_us, tmp);
+        autoupdate_restart(sensor);
+    }
+
+    return count;
+}
+
+/* cat adaptive */
+static DECL_ATTR_SHOW (adaptive)
+{
+    return sprintf(buf, "%d\n", to_dht22_sensor(kobj)->adaptive);
+}
+
+/*
+ * echo 1 > adaptive
+ * starts from the minimal interval
+ */
+static DECL_ATTR_STORE(adaptive)
+{
+    struct dht22_sensor* sensor = to_dht22_sensor(kobj);
+    int tmp;
+
+    if (1 == sscanf(buf, "%d\n", &tmp)) {
+        WRITE_ONCE(sensor->interval_sec, READ_ONCE(sensor->adaptive_sec[0]));
+        WRITE_ONCE(sensor->adaptive, 0 != tmp);
+        autoupdate_restart(sensor);
+    }
+
+    return count;
+}
+
+/* cat adaptive_sec, "<min> <max>" */
+static DECL_ATTR_SHOW (adaptive_sec)
+{
+    struct dht22_sensor* sensor = to_dht22_sensor(kobj);
+
+    return sprintf(buf, "%d %d\n", sensor->adaptive_sec[0],
+                                   sensor->adaptive_sec[1]);
+}
+
+/*
+ * echo 5 300 > adaptive_sec
+ * the current interval is clamped at the next reading
+ */
+static DECL_ATTR_STORE(adaptive_sec)
+{
+    struct dht22_sensor* sensor = to_dht22_sensor(kobj);
+    int lo;
+    int hi;
+
+    if (2 == sscanf(buf, "%d %d\n", &lo, &hi) &&
+        lo >= AUTOUPDATE_SEC_MIN && lo <= hi && hi <= AUTOUPDATE_SEC_MAX) {
+        WRITE_ONCE(sensor->adaptive_sec[0], lo);
+        WRITE_ONCE(sensor->adaptive_sec[1], hi);
+    }
+
+    return count;
+}
+
+/* cat adaptive_rate, "<humidity> <temperature>" in 0.1 units per minute */
+static DECL_ATTR_SHOW (adaptive_rate)
+{
+    struct dht22_sensor* sensor = to_dht22_sensor(kobj);
+
+    return sprintf(buf, "%d %d\n", sensor->adaptive_rate[0],
+                                   sensor->adaptive_rate[1]);
+}
+
+/* echo 10 5 > adaptive_rate */
+static DECL_ATTR_STORE(adaptive_rate)
+{
+    struct dht22_sensor* sensor = to_dht22_sensor(kobj);
+    int h;
+    int t;
+
+    if (2 == sscanf(buf, "%d %d\n", &h, &t) && h >= 0 && t >= 0) {
+        WRITE_ONCE(sensor->adaptive_rate[0], h);
+        WRITE_ONCE(sensor->adaptive_rate[1], t);
+    }
+
+    return count;
+}
+
+/* cat interval_sec, the effective seconds between two autoupdate triggers */
+static DECL_ATTR_SHOW (interval_sec)
+{
+    return sprintf(buf, "%d\n", autoupdate_period(to_dht22_sensor(kobj)));
+}
+
+/* cat idle_sec */
+static DECL_ATTR_SHOW (idle_sec)
+{
+    return sprintf(buf, "%d\n", to_dht22_sensor(kobj)->idle_sec);
+}
+
+/*
+ * echo 300 > idle_sec, 0 never pauses
+ * counted from now if nobody is reading
+ */
+static DECL_ATTR_STORE(idle_sec)
+{
+    struct dht22_sensor* sensor = to_dht22_sensor(kobj);
+    int tmp;
+
+    if (1 == sscanf(buf, "%d\n", &tmp) && tmp >= 0) {
+        WRITE_ONCE(sensor->idle_sec, tmp);
+        consumer_seen(sensor);
+    }
+
+    return count;
+}
+
+/*
+ * cat consumers, "<open files and IIO buffers> <paused>"
+ * not a read of the sensor itself, it doesn't resume autoupdate
+ */
+static DECL_ATTR_SHOW (consumers)
+{
+    struct dht22_sensor* sensor = to_dht22_sensor(kobj);
+
+    return sprintf(buf, "%d %d\n", atomic_read(&sensor->consumers),
+                                   READ_ONCE(sensor->paused));
+}
+
+/* cat humidity */
+static DECL_ATTR_SHOW (humidity)
+{
+    consumer_seen(to_dht22_sensor(kobj));
+    return get_text(to_dht22_sensor(kobj), DHT22_TEXT_SYSFS_HUMIDITY, buf,
+                    NULL);
+}
+
+/* cat temperature */
+static DECL_ATTR_SHOW (temperature)
+{
+    consumer_seen(to_dht22_sensor(kobj));
+    return get_text(to_dht22_sensor(kobj), DHT22_TEXT_SYSFS_TEMPERATURE, buf,
+                    NULL);
+}
+
+/* cat reading, "<humidity> <temperature>" of the same conversion */
+static DECL_ATTR_SHOW (reading)
+{
+    consumer_seen(to_dht22_sensor(kobj));
+    return get_text(to_dht22_sensor(kobj), DHT22_TEXT_READING, buf, NULL);
+}
+
+/* echo 1 > trigger */
+static DECL_ATTR_STORE(trigger)
+{
+    struct dht22_sensor* sensor = to_dht22_sensor(kobj);
+
+    to_trigger_dht22(sensor, 0);
+    if (dbg_flag)
+        pr_info("Now trigger DHT22 %d.\n", sensor->id);
+    return count;
+}
+
+/* cat max_age_ms */
+static DECL_ATTR_SHOW (max_age_ms)
+{
+    return sprintf(buf, "%d\n", to_dht22_sensor(kobj)->max_age_ms);
+}
+
+/*
+ * echo 1000 > max_age_ms
+ * max_age of /dev/dht22* files opened from now on, 0 to never wait
+ */
+static DECL_ATTR_STORE(max_age_ms)
+{
+    struct dht22_sensor* sensor = to_dht22_sensor(kobj);
+    int tmp;
+
+    if (1 == sscanf(buf, "%d\n", &tmp) && tmp >= 0)
+        WRITE_ONCE(sensor->max_age_ms, tmp);
+
+    return count;
+}
+
+/* cat retries */
+static DECL_ATTR_SHOW (retries)
+{
+    return sprintf(buf, "%d\n", to_dht22_sensor(kobj)->retries);
+}
+
+/* echo 3 > retries */
+static DECL_ATTR_STORE(retries)
+{
+    struct dht22_sensor* sensor = to_dht22_sensor(kobj);
+    int tmp;
+
+    if (1 == sscanf(buf, "%d\n", &tmp) && tmp >= 0 && tmp <= DHT22_RETRIES_MAX)
+        sensor->retries = tmp;
+
+    return count;
+}
+
+/* cat capture */
+static DECL_ATTR_SHOW (capture)
+{
+    return sprintf(buf, "%d\n", to_dht22_sensor(kobj)->capture);
+}
+
+/*
+ * echo 1 > capture
+ * takes effect from the next trigger
+ */
+static DECL_ATTR_STORE(capture)
+{
+    struct dht22_sensor* sensor = to_dht22_sensor(kobj);
+    int tmp;
+
+    if (1 == sscanf(buf, "%d\n", &tmp) && tmp >= 0 && tmp < DHT22_CAPTURES)
+        WRITE_ONCE(sensor->capture, tmp);
+
+    return count;
+}
+
+/*
+ * cat capture_stats, one line for each capture mode:
+ * "<mode> <reads> <successes> <CPU us per read>"
+ */
+static DECL_ATTR_SHOW (capture_stats)
+{
+    static const char* const names[DHT22_CAPTURES] = { "irq", "poll" };
+    struct dht22_sensor* sensor = to_dht22_sensor(kobj);
+    int len = 0;
+    int i;
+
+    for (i = 0; i < DHT22_CAPTURES; ++i) {
+        u32 reads  = sensor->capture_reads[i];
+        u64 cpu_us = div_u64(sensor->capture_cpu_ns[i], NSEC_PER_USEC);
+
+        len += sprintf(buf + len, "%s %u %u %llu\n", names[i], reads,
+                       sensor->capture_successes[i],
+                       reads ? div_u64(cpu_us, reads) : 0);
+    }
+    return len;
+}
+
+/*
+ * cat retry_stats, one line for each retry level:
+ * "<level> <attempts> <successes>", level 0 is the regular trigger
+ */
+static DECL_ATTR_SHOW (retry_stats)
+{
+    struct dht22_sensor* sensor = to_dht22_sensor(kobj);
+    int len = 0;
+    int i;
+
+    for (i = 0; i <= DHT22_RETRIES_MAX; ++i) {
+        len += sprintf(buf + len, "%d %u %u\n", i,
+                       sensor->retry_attempts[i], sensor->retry_successes[i]);
+    }
+    return len;
+}
+
+/* cat deadband, "<humidity> <temperature>" in 0.1 units */
+static DECL_ATTR_SHOW (deadband)
+{
+    struct dht22_sensor* sensor = to_dht22_sensor(kobj);
+
+    return sprintf(buf, "%d %d\n", sensor->deadband[0], sensor->deadband[1]);
+}
+
+/*
+ * echo 5 2 > deadband
+ * from the next reading, 0 0 to notify every reading
+ */
+static DECL_ATTR_STORE(deadband)
+{
+    struct dht22_sensor* sensor = to_dht22_sensor(kobj);
+    int h;
+    int t;
+
+    if (2 == sscanf(buf, "%d %d\n", &h, &t) &&
+        h >= 0 && h <= DEADBAND_MAX && t >= 0 && t <= DEADBAND_MAX) {
+        WRITE_ONCE(sensor->deadband[0], h);
+        WRITE_ONCE(sensor->deadband[1], t);
+    }
+
+    return count;
+}
+
+/* cat heartbeat_sec */
+static DECL_ATTR_SHOW (heartbeat_sec)
+{
+    return sprintf(buf, "%d\n", to_dht22_sensor(kobj)->heartbeat_sec);
+}
+
+/* echo 600 > heartbeat_sec, 0 to disable */
+static DECL_ATTR_STORE(heartbeat_sec)
+{
+    struct dht22_sensor* sensor = to_dht22_sensor(kobj);
+    int tmp;
+
+    if (1 == sscanf(buf, "%d\n", &tmp) && tmp >= 0)
+        WRITE_ONCE(sensor->heartbeat_sec, tmp);
+
+    return count;
+}
+
+/*
+ * cat stats, one line for each window, in 0.1 units:
+ * "<window sec> <count> <humidity min max mean stddev>
+ *  <temperature min max mean stddev>"
+ */
+static DECL_ATTR_SHOW (stats)
+{
+    struct dht22_stats stats;
+    int len = 0;
+    int w;
+
+    consumer_seen(to_dht22_sensor(kobj));
+    get_stats(to_dht22_sensor(kobj), &stats);
+    for (w = 0; w < DHT22_STATS_WINDOWS; ++w) {
+        const struct dht22_window_stats* ws = &stats.window[w];
+        const struct dht22_stat*         st[2] = { &ws->humidity,
+                                                   &ws->temperature };
+        int                              q;
+
+        len += sprintf(buf + len, "%u %u", ws->window_sec, ws->count);
+        for (q = 0; q < 2; ++q) {
+            buf[len++] = ' ';
+            len += sprint_tenths(buf + len, st[q]->min);
+            buf[len++] = ' ';
+            len += sprint_tenths(buf + len, st[q]->max);
+            buf[len++] = ' ';
+            len += sprint_tenths(buf + len, st[q]->mean);
+            buf[len++] = ' ';
+            len += sprint_tenths(buf + len, st[q]->stddev);
+        }
+        buf[len++] = '\n';
+    }
+    return len;
+}
+
+/* cat stats_windows */
+static DECL_ATTR_SHOW (stats_windows)
+{
+    struct dht22_sensor* sensor = to_dht22_sensor(kobj);
+    int len = 0;
+    int w;
+
+    mutex_lock(&sensor->stats_lock);
+    for (w = 0; w < DHT22_STATS_WINDOWS; ++w) {
+        len += sprintf(buf + len, "%u%c", sensor->windows[w].window_sec,
+                       DHT22_STATS_WINDOWS - 1 == w ? '\n' : ' ');
+    }
+    mutex_unlock(&sensor->stats_lock);
+    return len;
+}
+
+/*
+ * echo 300 3600 86400 > stats_windows
+ * all windows start over empty; the EWMA is kept
+ */
+static DECL_ATTR_STORE(stats_windows)
+{
+    struct dht22_sensor* sensor = to_dht22_sensor(kobj);
+    u32 tmp[DHT22_STATS_WINDOWS];
+    int w;
+
+    if (DHT22_STATS_WINDOWS != sscanf(buf, "%u %u %u\n",
+                                      &tmp[0], &tmp[1], &tmp[2]))
+        return count;
+    for (w = 0; w < DHT22_STATS_WINDOWS; ++w) {
+        if (tmp[w] < STATS_WINDOW_SEC_MIN || tmp[w] > STATS_WINDOW_SEC_MAX)
+            return count;
+    }
+
+    mutex_lock(&sensor->stats_lock);
+    for (w = 0; w < DHT22_STATS_WINDOWS; ++w) {
+        struct dht22_window* win = &sensor->windows[w];
+
+        memset(win->bucket, 0, sizeof(win->bucket));
+        win->window_sec = tmp[w];
+        win->bucket_ns  = div_u64((u64)tmp[w] * NSEC_PER_SEC,
+                                  DHT22_STATS_BUCKETS);
+    }
+    stats_publish(sensor, sensor->stats.timestamp_ns, sensor->stats.count);
+    mutex_unlock(&sensor->stats_lock);
+
+    return count;
+}
+
+/* cat ewma, "<humidity> <temperature>" */
+static DECL_ATTR_SHOW (ewma)
+{
+    struct dht22_stats stats;
+    int                len;
+
+    consumer_seen(to_dht22_sensor(kobj));
+    get_stats(to_dht22_sensor(kobj), &stats);
+    len  = sprint_tenths(buf, stats.ewma_humidity);
+    buf[len++] = ' ';
+    len += sprint_tenths(buf + len, stats.ewma_temperature);
+    buf[len++] = '\n';
+    return len;
+}
+
+/* cat ewma_alpha */
+static DECL_ATTR_SHOW (ewma_alpha)
+{
+    return sprintf(buf, "%d\n", to_dht22_sensor(kobj)->ewma_alpha);
+}
+
+/*
+ * echo 50 > ewma_alpha
+ * weight of a new reading in per mille, 1 ~ 1000; from the next reading
+ */
+static DECL_ATTR_STORE(ewma_alpha)
+{
+    struct dht22_sensor* sensor = to_dht22_sensor(kobj);
+    int tmp;
+
+    if (1 != sscanf(buf, "%d\n", &tmp) || tmp < 1 || tmp > 1000)
+        return count;
+
+    mutex_lock(&sensor->stats_lock);
+    sensor->ewma_alpha = tmp;
+    stats_publish(sensor, sensor->stats.timestamp_ns, sensor->stats.count);
+    mutex_unlock(&sensor->stats_lock);
+
+    return count;
+}
+
+/* echo 1 > debug */
+static DECL_ATTR_STORE(debug)
+{
+    int tmp;
+
+    sscanf(buf, "%d\n", &tmp);
+    dbg_flag = 0 != tmp;
+
+    return count;
+}
+
+module_init(dht22_init);
+module_exit(dht22_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("Edward Lin <edwardlin.tw@gmail.com");
+MODULE_DESCRIPTION("A driver for DHT22 humidity/temperature sensor");
+MODULE_VERSION("0.1");
+
@@ -0,0 +1,102 @@
+#!/bin/bash
+#
+# simulated DHT22 on a gpio-sim chip, to run dht22d on any Linux box
+# (kernel with CONFIG_GPIO_SIM, as root)
+#
+# usage: dht22_sim.sh [-l line] [-T factor] [humidity temperature]
+#
+# humidity and temperature in 0.1 units, default 653 -52 (65.3 %RH,
+# -5.2 °C). Creates a gpio-sim chip, prints its /dev/gpiochip<N>, then
+# answers every start pulse of the host on <line> (default 4) with a
+# frame of these values, 'factor' (default 1000) times slower than
+# DHT22, as a script can't toggle a line within microseconds:
+#
+#   ./dht22_sim.sh 653 -52 &
+#   ./dht22d -c /dev/gpiochip<N> -T 1000 -i 3 -n 3 -v
+#
+# the chip is removed on exit
+#
+# the frame loop has run with dht22d on a stand-in for gpio-sim; the
+# configfs/sysfs setup of the chip is not verified yet, see README
+
+line=4
+slow=1000
+while getopts "l:T:" o; do
+    case $o in
+    l) line=$OPTARG ;;
+    T) slow=$OPTARG ;;
+    *) echo "usage: $0 [-l line] [-T factor] [humidity temperature]" >&2
+       exit 2 ;;
+    esac
+done
+shift $((OPTIND - 1))
+humidity=${1:-653}
+temperature=${2:-'-52'}
+
+config=/sys/kernel/config/gpio-sim/dht22
+modprobe gpio-sim 2>/dev/null
+mountpoint -q /sys/kernel/config || mount -t configfs none /sys/kernel/config
+if ! mkdir $config 2>/dev/null; then
+    echo "can't create $config: gpio-sim not available, or not root?" >&2
+    exit 1
+fi
+mkdir $config/bank0
+echo $((line + 1)) > $config/bank0/num_lines
+echo 1 > $config/live
+
+cleanup() {
+    echo 0 > $config/live
+    rmdir $config/bank0 $config
+}
+trap cleanup EXIT
+trap 'exit 0' INT TERM
+
+sim=/sys/devices/platform/$(cat $config/dev_name)/$(cat $config/bank0/chip_name)/sim_gpio$line
+echo /dev/$(cat $config/bank0/chip_name)
+
+# DHT22 has a pull-up resistor on its data line
+echo pull-up > $sim/pull
+
+# sleep without forking, too slow for 'factor' below ~1000 otherwise
+exec {sleep_fd}<> <(:)
+pause() {
+    read -t "$1" -u $sleep_fd
+}
+
+# DHT22 timings in usec, 'factor' times slower, in sec
+scale() {
+    awk "BEGIN { printf \"%.6f\", $1 * $slow / 1000000 }"
+}
+t_wait=$(scale 30)          # after the host released the bus
+t_response=$(scale 80)      # LOW, then HIGH
+t_low=$(scale 50)
+t_high0=$(scale 26)
+t_high1=$(scale 70)
+t_poll=$(scale 20)
+
+# 2-byte humidity, 2-byte temperature (sign bit, not 2's complement), CRC
+raw_t=$temperature
+[ $raw_t -lt 0 ] && raw_t=$(( (-raw_t) | 0x8000 ))
+bytes=($((humidity >> 8 & 0xFF)) $((humidity & 0xFF))
+       $((raw_t >> 8 & 0xFF)) $((raw_t & 0xFF)))
+bytes+=($(( (bytes[0] + bytes[1] + bytes[2] + bytes[3]) & 0xFF )))
+
+while true; do
+    # host start pulse: the line driven LOW, then released
+    while read v < $sim/value && [ "$v" = 1 ]; do pause $t_poll; done
+    while read v < $sim/value && [ "$v" = 0 ]; do pause $t_poll; done
+
+    pause $t_wait
+    echo pull-down > $sim/pull; pause $t_response
+    echo pull-up   > $sim/pull; pause $t_response
+    for byte in "${bytes[@]}"; do
+        for bit in 7 6 5 4 3 2 1 0; do
+            echo pull-down > $sim/pull; pause $t_low
+            echo pull-up   > $sim/pull
+            if (( byte >> bit & 1 )); then pause $t_high1; else pause $t_high0; fi
+        done
+    done
+    # release the bus after the last bit
+    echo pull-down > $sim/pull; pause $t_low
+    echo pull-up   > $sim/pull
+done
@@ -0,0 +1,192 @@
+/*
+ * DHT22 Humidity And Temperature Sensor Driver, tracepoints
+ *
+ * Copyright (c) Edward Lin <edwardlin.tw@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * one transaction of sensor <id>, in order:
+ * dht22_trigger, dht22_start_release, dht22_edge (one per edge),
+ * dht22_frame_complete and dht22_decode; or dht22_timeout if
+ * too few edges were captured
+ *
+ * to record them:
+ *   echo 1 > /sys/kernel/debug/tracing/events/dht22/enable
+ *   cat /sys/kernel/debug/tracing/trace_pipe
+ * or: perf record -e 'dht22:*' -a
+ */
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM dht22
+
+#if !defined(_DHT22_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _DHT22_TRACE_H
+
+#include <linux/tracepoint.h>
+
+/* 'busy': ignored, the previous transaction is still in progress */
+TRACE_EVENT(dht22_trigger,
+
+    TP_PROTO(int id, int retry_level, int capture, bool busy),
+
+    TP_ARGS(id, retry_level, capture, busy),
+
+    TP_STRUCT__entry(
+        __field(int,    id)
+        __field(int,    retry_level)
+        __field(int,    capture)
+        __field(bool,   busy)
+    ),
+
+    TP_fast_assign(
+        __entry->id          = id;
+        __entry->retry_level = retry_level;
+        __entry->capture     = capture;
+        __entry->busy        = busy;
+    ),
+
+    TP_printk("sensor=%d retry=%d capture=%s%s", __entry->id,
+              __entry->retry_level, __entry->capture ? "poll" : "irq",
+              __entry->busy ? " busy" : "")
+);
+
+/* bus released after the start pulse of 'pulse_ns' */
+TRACE_EVENT(dht22_start_release,
+
+    TP_PROTO(int id, u64 pulse_ns),
+
+    TP_ARGS(id, pulse_ns),
+
+    TP_STRUCT__entry(
+        __field(int,    id)
+        __field(u64,    pulse_ns)
+    ),
+
+    TP_fast_assign(
+        __entry->id       = id;
+        __entry->pulse_ns = pulse_ns;
+    ),
+
+    TP_printk("sensor=%d pulse=%lluns", __entry->id, __entry->pulse_ns)
+);
+
+/* edge 'index' of the transaction, level after the edge */
+TRACE_EVENT(dht22_edge,
+
+    TP_PROTO(int id, int index, int level, u32 delta_ns),
+
+    TP_ARGS(id, index, level, delta_ns),
+
+    TP_STRUCT__entry(
+        __field(int,    id)
+        __field(int,    index)
+        __field(int,    level)
+        __field(u32,    delta_ns)
+    ),
+
+    TP_fast_assign(
+        __entry->id       = id;
+        __entry->index    = index;
+        __entry->level    = level;
+        __entry->delta_ns = delta_ns;
+    ),
+
+    TP_printk("sensor=%d edge=%d level=%d delta=%uns", __entry->id,
+              __entry->index, __entry->level, __entry->delta_ns)
+);
+
+/* edge log handed over to the decoder */
+TRACE_EVENT(dht22_frame_complete,
+
+    TP_PROTO(int id, int edges),
+
+    TP_ARGS(id, edges),
+
+    TP_STRUCT__entry(
+        __field(int,    id)
+        __field(int,    edges)
+    ),
+
+    TP_fast_assign(
+        __entry->id    = id;
+        __entry->edges = edges;
+    ),
+
+    TP_printk("sensor=%d edges=%d", __entry->id, __entry->edges)
+);
+
+/* 'ret': 0, -EIO (checksum mismatch) or -ENODATA (incomplete frame) */
+TRACE_EVENT(dht22_decode,
+
+    TP_PROTO(int id, const u8* data, int ret, int bits, int repaired,
+             int humidity, int temperature),
+
+    TP_ARGS(id, data, ret, bits, repaired, humidity, temperature),
+
+    TP_STRUCT__entry(
+        __field(int,    id)
+        __array(u8,     data, 5)
+        __field(int,    ret)
+        __field(int,    bits)
+        __field(int,    repaired)
+        __field(int,    humidity)
+        __field(int,    temperature)
+    ),
+
+    TP_fast_assign(
+        __entry->id          = id;
+        memcpy(__entry->data, data, 5);
+        __entry->ret         = ret;
+        __entry->bits        = bits;
+        __entry->repaired    = repaired;
+        __entry->humidity    = humidity;
+        __entry->temperature = temperature;
+    ),
+
+    TP_printk("sensor=%d raw=%02x%02x%02x%02x%02x %s bits=%d repaired=%d "
+              "humidity=%d temperature=%d", __entry->id,
+              __entry->data[0], __entry->data[1], __entry->data[2],
+              __entry->data[3], __entry->data[4],
+              0 == __entry->ret ? "ok" :
+              -ENODATA == __entry->ret ? "incomplete" : "crc_error",
+              __entry->bits, __entry->repaired,
+              __entry->humidity, __entry->temperature)
+);
+
+/* too few edges to decode anything */
+TRACE_EVENT(dht22_timeout,
+
+    TP_PROTO(int id, int edges),
+
+    TP_ARGS(id, edges),
+
+    TP_STRUCT__entry(
+        __field(int,    id)
+        __field(int,    edges)
+    ),
+
+    TP_fast_assign(
+        __entry->id    = id;
+        __entry->edges = edges;
+    ),
+
+    TP_printk("sensor=%d edges=%d", __entry->id, __entry->edges)
+);
+
+#endif /* _DHT22_TRACE_H */
+
+/* this part must be outside protection */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE dht22_trace
+#include <trace/define_trace.h>
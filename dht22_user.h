@@ -0,0 +1,185 @@
+/*
+ * DHT22 Humidity And Temperature Sensor Driver
+ * data layouts shared between the driver and user space applications
+ * 
+ * Copyright (c) Edward Lin <edwardlin.tw@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ */
+#ifndef _DHT22_USER_H
+#define _DHT22_USER_H
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+/*
+ * status of a record
+ */
+#define DHT22_STATUS_OK         0
+#define DHT22_STATUS_CRC_ERROR  1
+#define DHT22_STATUS_INCOMPLETE 2       /* too many edges lost to decode */
+
+/*
+ * one conversion, as read from /dev/dht22_history:<n>
+ * humidity is 10 times of %RH, temperature is 10 times of °C
+ * timestamp is CLOCK_MONOTONIC in nanoseconds
+ */
+struct dht22_record {
+    __u64   seq;
+    __u64   timestamp_ns;
+    __s32   humidity;
+    __s32   temperature;
+    __u32   status;
+    __u32   reserved;
+};
+
+/*
+ * ioctl() of /dev/dht22:<2n>, /dev/dht22:<2n+1> and /dev/dht22_reading:<n>,
+ * per open file
+ *
+ * DHT22_IOC_SET_MODE, arg is DHT22_MODE_TEXT (default) or DHT22_MODE_BINARY;
+ * in binary mode, every read() returns one struct dht22_record:
+ * seq/timestamp/humidity/temperature of the latest good reading
+ * (seq counts good readings), status of the latest conversion
+ * (not DHT22_STATUS_OK if it failed after that reading)
+ */
+#define DHT22_MODE_TEXT         0
+#define DHT22_MODE_BINARY       1
+
+/*
+ * DHT22_IOC_SET_MAX_AGE, arg is in msec; if the latest reading is older,
+ * read() triggers a conversion (or joins the one in progress) and sleeps
+ * until it's done, then returns the reading, fresh unless the conversion
+ * failed; not within 2 seconds of the previous conversion though.
+ * 0 (default, or sysfs 'max_age_ms' at open()) returns the latest reading
+ * at once, as does O_NONBLOCK
+ */
+
+#define DHT22_IOC_MAGIC         'D'
+#define DHT22_IOC_SET_MODE      _IO (DHT22_IOC_MAGIC, 1)
+#define DHT22_IOC_GET_MODE      _IOR(DHT22_IOC_MAGIC, 2, int)
+#define DHT22_IOC_SET_MAX_AGE   _IO (DHT22_IOC_MAGIC, 4)
+#define DHT22_IOC_GET_MAX_AGE   _IOR(DHT22_IOC_MAGIC, 5, int)
+
+/*
+ * rolling statistics of one quantity over a window, in 0.1 units;
+ * stddev is the population standard deviation
+ */
+struct dht22_stat {
+    __s32   min;
+    __s32   max;
+    __s32   mean;
+    __s32   stddev;
+};
+
+#define DHT22_STATS_WINDOWS     3
+
+struct dht22_window_stats {
+    __u32               window_sec;
+    __u32               count;          /* good readings in the window */
+    struct dht22_stat   humidity;
+    struct dht22_stat   temperature;
+};
+
+/*
+ * DHT22_IOC_GET_STATS, statistics of the sensor as of its latest good
+ * reading, the same as sysfs 'stats' and 'ewma'; windows are the last
+ * 'window_sec' seconds before 'timestamp_ns', at 1/60 window granularity
+ */
+struct dht22_stats {
+    __u64                       count;          /* good readings since loaded */
+    __u64                       timestamp_ns;   /* CLOCK_MONOTONIC */
+    __s32                       ewma_humidity;
+    __s32                       ewma_temperature;
+    __u32                       ewma_alpha;     /* per mille */
+    __u32                       reserved;
+    struct dht22_window_stats   window[DHT22_STATS_WINDOWS];
+};
+
+#define DHT22_IOC_GET_STATS     _IOR(DHT22_IOC_MAGIC, 3, struct dht22_stats)
+
+/*
+ * read-only page mapped by mmap() on /dev/dht22:<2n>, /dev/dht22:<2n+1> or
+ * /dev/dht22_reading:<n>,
+ * always at offset 0 with length <= page size; holds the latest good
+ * reading of sensor <n>
+ *
+ * 'seq' is a seqcount: odd while the driver is updating the page;
+ * a reader copies the fields and retries if 'seq' was odd or changed,
+ * see dht22_shm_read() below
+ */
+struct dht22_shm {
+    __u32   seq;
+    __u32   reserved;
+    __u64   count;          /* readings published since loaded */
+    __u64   timestamp_ns;   /* CLOCK_MONOTONIC */
+    __s32   humidity;
+    __s32   temperature;
+};
+
+/*
+ * generic netlink family "dht22", multicast group "readings":
+ * one DHT22_CMD_READING message for every conversion of every sensor,
+ * good or not; several of them may come in one datagram.
+ * DHT22_CMD_GET with DHT22_A_SENSOR is answered with one
+ * DHT22_CMD_READING of the latest reading of that sensor.
+ * attributes are those of struct dht22_record, plus the sensor index
+ */
+#define DHT22_GENL_NAME         "dht22"
+#define DHT22_GENL_VERSION      1
+#define DHT22_GENL_MCGRP        "readings"
+
+enum dht22_genl_cmd {
+    DHT22_CMD_UNSPEC,
+    DHT22_CMD_READING,
+    DHT22_CMD_GET,
+    __DHT22_CMD_MAX
+};
+
+enum dht22_genl_attr {
+    DHT22_A_UNSPEC,
+    DHT22_A_PAD,
+    DHT22_A_SENSOR,                 /* u32 */
+    DHT22_A_SEQ,                    /* u64 */
+    DHT22_A_TIMESTAMP,              /* u64, CLOCK_MONOTONIC ns */
+    DHT22_A_HUMIDITY,               /* s32, 0.1 %RH */
+    DHT22_A_TEMPERATURE,            /* s32, 0.1 °C */
+    DHT22_A_STATUS,                 /* u32, DHT22_STATUS_* */
+    __DHT22_A_MAX
+};
+#define DHT22_A_MAX             (__DHT22_A_MAX - 1)
+
+#ifndef __KERNEL__
+/*
+ * consistent snapshot of the page, without any syscall
+ * (GCC/Clang atomic builtins)
+ */
+static inline void dht22_shm_read(const volatile struct dht22_shm* shm,
+                                  struct dht22_shm* out)
+{
+    __u32 seq;
+
+    do {
+        while ((seq = __atomic_load_n(&shm->seq, __ATOMIC_ACQUIRE)) & 1)
+            ;
+        out->count        = shm->count;
+        out->timestamp_ns = shm->timestamp_ns;
+        out->humidity     = shm->humidity;
+        out->temperature  = shm->temperature;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while (seq != __atomic_load_n(&shm->seq, __ATOMIC_RELAXED));
+
+    out->seq      = seq;
+    out->reserved = 0;
+}
+#endif /* __KERNEL__ */
+
+#endif /* _DHT22_USER_H */
@@ -0,0 +1,534 @@
+/*
+ * user-space DHT22 driver on the GPIO character device, for boards
+ * where dht22.ko can't be built or loaded: the same trigger as
+ * trigger_dht22() and the same decoder as process_results()
+ * (dht22_decode.c), with the edges timestamped by the kernel's GPIO
+ * edge events, read in batches from the line's event queue
+ *
+ * usage: dht22d [-c chip] [-l line] [-i seconds] [-r retries]
+ *               [-u socket] [-m shm_file] [-n conversions] [-T factor] [-v]
+ *
+ *  -c  GPIO chip, default /dev/gpiochip0
+ *  -l  line offset on the chip, default 4 (BCM GPIO 4 on the Pi)
+ *  -i  seconds between two conversions, default 10, at least 3
+ *  -r  retries of a failed conversion, default 3, at most 5; the first
+ *      one 2 seconds later, then 4, 8, 16 and 16 seconds
+ *  -u  Unix socket (SOCK_SEQPACKET) to publish on: every client gets one
+ *      struct dht22_record per conversion, and the latest when it
+ *      connects; a client which doesn't keep up is dropped
+ *  -m  file (e.g. /dev/shm/dht22) holding a struct dht22_shm updated for
+ *      every good reading, to mmap() and read with dht22_shm_read()
+ *  -n  exit after that many conversions, good or not; default never
+ *  -T  slow motion: all DHT22 timings are this many times longer, for a
+ *      simulated sensor (dht22_sim.sh on gpio-sim), default 1
+ *  -v  print each conversion:
+ *      "<seq> <timestamp sec> <humidity> <temperature> <status> <edges>"
+ *
+ * run at -T 1000 against dht22_sim.sh's frames on a stand-in for
+ * gpio-sim, not yet on gpio-sim itself or a sensor, see README
+ *
+ * records are those of /dev/dht22_reading:<n> in binary mode (see
+ * dht22_user.h): seq counts good readings, status is the latest
+ * conversion's; timestamps are CLOCK_MONOTONIC
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <linux/gpio.h>
+#include "dht22_decode.h"
+#include "dht22_user.h"
+
+#define NSEC_PER_SEC            1000000000ULL
+#define START_PULSE_NS          1000000     /* host start pulse, 1ms */
+#define CAPTURE_WINDOW_NS       5500000     /* after the start pulse */
+#define FRAME_END_NS            240000      /* HIGH longer than any pulse */
+#define MIN_INTERVAL_SEC        2           /* between two conversions */
+#define INTERVAL_SEC_MIN        3
+#define RETRIES_MAX             5
+#define RETRY_MAX_SEC           16
+#define EVENT_BUFFER_SIZE       128         /* > DHT22_EDGES_MAX */
+#define EVENT_BATCH             16          /* events per read() */
+#define CLIENTS_MAX             32
+
+struct options_t {
+    const char* chip;
+    int         line;
+    int         interval_sec;
+    int         retries;
+    const char* socket_path;
+    const char* shm_path;
+    long        conversions;
+    int         slow;
+    int         verbose;
+};
+
+static struct options_t opt = {
+    .chip         = "/dev/gpiochip0",
+    .line         = 4,
+    .interval_sec = 10,
+    .retries      = 3,
+    .slow         = 1,
+};
+
+static volatile sig_atomic_t    stop;
+static int                      clients[CLIENTS_MAX];
+static int                      nclients;
+
+static int      line_request(void);
+static int      line_config(int fd, uint64_t flags, int value);
+static int      convert(int fd, struct dht22_record* rec, int* edges);
+static int      capture(int fd, struct dht22_edge* log, uint64_t trigger_ns);
+static int      socket_init(const char* path);
+static void     socket_accept(int sock, const struct dht22_record* latest);
+static void     socket_publish(const struct dht22_record* rec);
+static struct dht22_shm* shm_init(const char* path);
+static void     shm_publish(struct dht22_shm* shm, const struct dht22_record* rec);
+static void     drain(int fd);
+static void     sprint_tenths(char* buf, int data);
+static uint64_t now_ns(void);
+static void     sleep_until(uint64_t ns);
+static void     on_signal(int sig);
+
+int main(int argc, char* argv[])
+{
+    struct dht22_record rec;
+    struct dht22_shm*   shm = NULL;
+    struct sigaction    sa;
+    uint64_t            next;
+    long                done = 0;
+    int                 converted = 0;
+    int                 retry_level = 0;
+    int                 sock = -1;
+    int                 fd;
+    int                 c;
+
+    while (-1 != (c = getopt(argc, argv, "c:l:i:r:u:m:n:T:v"))) {
+        switch (c) {
+        case 'c': opt.chip         = optarg; break;
+        case 'l': opt.line         = atoi(optarg); break;
+        case 'i': opt.interval_sec = atoi(optarg); break;
+        case 'r': opt.retries      = atoi(optarg); break;
+        case 'u': opt.socket_path  = optarg; break;
+        case 'm': opt.shm_path     = optarg; break;
+        case 'n': opt.conversions  = atol(optarg); break;
+        case 'T': opt.slow         = atoi(optarg); break;
+        case 'v': opt.verbose      = 1; break;
+        default:
+            fprintf(stderr, "usage: %s [-c chip] [-l line] [-i seconds] "
+                            "[-r retries] [-u socket] [-m shm_file]\n"
+                            "       [-n conversions] [-T factor] [-v]\n",
+                            argv[0]);
+            return 2;
+        }
+    }
+    if (opt.interval_sec < INTERVAL_SEC_MIN)
+        opt.interval_sec = INTERVAL_SEC_MIN;
+    if (opt.retries < 0)
+        opt.retries = 0;
+    if (opt.retries > RETRIES_MAX)
+        opt.retries = RETRIES_MAX;
+    if (opt.slow < 1)
+        opt.slow = 1;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    fd = line_request();
+    if (fd < 0)
+        return 1;
+    if (opt.socket_path && (sock = socket_init(opt.socket_path)) < 0)
+        return 1;
+    if (opt.shm_path && NULL == (shm = shm_init(opt.shm_path)))
+        return 1;
+
+    memset(&rec, 0, sizeof(rec));
+    rec.status = DHT22_STATUS_INCOMPLETE;
+
+    /* DHT22 needs 2 seconds after power on, as the driver at load */
+    next = now_ns() + MIN_INTERVAL_SEC * NSEC_PER_SEC;
+    while (!stop) {
+        int edges;
+        int delay_sec;
+
+        /* serve new clients while waiting for the next conversion */
+        while (!stop && now_ns() < next) {
+            struct pollfd   pfd = { .fd = sock, .events = POLLIN };
+            uint64_t        left = next - now_ns();
+            struct timespec ts = { left / NSEC_PER_SEC, left % NSEC_PER_SEC };
+
+            if (sock < 0) {
+                sleep_until(next);
+                break;
+            }
+            if (ppoll(&pfd, 1, &ts, NULL) > 0)
+                socket_accept(sock, converted ? &rec : NULL);
+        }
+        if (stop)
+            break;
+
+        if (0 == convert(fd, &rec, &edges)) {
+            retry_level = 0;
+            delay_sec   = opt.interval_sec;
+            if (shm)
+                shm_publish(shm, &rec);
+        }
+        else if (retry_level < opt.retries) {
+            delay_sec = MIN_INTERVAL_SEC << retry_level++;
+            if (delay_sec > RETRY_MAX_SEC)
+                delay_sec = RETRY_MAX_SEC;
+        }
+        else {
+            retry_level = 0;
+            delay_sec   = opt.interval_sec;
+        }
+        converted = 1;
+        socket_publish(&rec);
+
+        if (opt.verbose) {
+            char humidity[16];
+            char temperature[16];
+
+            sprint_tenths(humidity, rec.humidity);
+            sprint_tenths(temperature, rec.temperature);
+            printf("%llu %llu.%06llu %s %s %s %d\n",
+                   (unsigned long long)rec.seq,
+                   (unsigned long long)(rec.timestamp_ns / NSEC_PER_SEC),
+                   (unsigned long long)(rec.timestamp_ns % NSEC_PER_SEC / 1000),
+                   humidity, temperature,
+                   DHT22_STATUS_OK == rec.status ? "ok" :
+                   DHT22_STATUS_CRC_ERROR == rec.status ? "crc_error" :
+                   "incomplete", edges);
+            fflush(stdout);
+        }
+        if (opt.conversions > 0 && ++done >= opt.conversions)
+            break;
+
+        /* not slowed down by -T, a conversion is synchronous anyway */
+        next = now_ns() + (uint64_t)delay_sec * NSEC_PER_SEC;
+    }
+
+    if (opt.socket_path)
+        unlink(opt.socket_path);
+    return 0;
+}
+
+/*
+ * the line, released (input) between conversions; edge detection is
+ * only turned on while capturing
+ */
+static int line_request(void)
+{
+    struct gpio_v2_line_request req;
+    int                         chip;
+
+    chip = open(opt.chip, O_RDWR | O_CLOEXEC);
+    if (chip < 0) {
+        perror(opt.chip);
+        return -1;
+    }
+
+    memset(&req, 0, sizeof(req));
+    req.offsets[0]        = opt.line;
+    req.num_lines         = 1;
+    req.config.flags      = GPIO_V2_LINE_FLAG_INPUT;
+    req.event_buffer_size = EVENT_BUFFER_SIZE;
+    strcpy(req.consumer, "dht22d");
+    if (ioctl(chip, GPIO_V2_GET_LINE_IOCTL, &req) < 0) {
+        fprintf(stderr, "%s line %d: %s\n", opt.chip, opt.line,
+                strerror(errno));
+        close(chip);
+        return -1;
+    }
+
+    close(chip);
+    return req.fd;
+}
+
+static int line_config(int fd, uint64_t flags, int value)
+{
+    struct gpio_v2_line_config config;
+
+    memset(&config, 0, sizeof(config));
+    config.flags = flags;
+    if (flags & GPIO_V2_LINE_FLAG_OUTPUT) {
+        config.num_attrs                = 1;
+        config.attrs[0].mask            = 1;
+        config.attrs[0].attr.id         = GPIO_V2_LINE_ATTR_ID_OUTPUT_VALUES;
+        config.attrs[0].attr.values     = value;
+    }
+    return ioctl(fd, GPIO_V2_LINE_SET_CONFIG_IOCTL, &config);
+}
+
+/*
+ * one transaction, as trigger_dht22()/start_func() and process_results():
+ * pull the bus down for 1ms, release it and log DHT22's edges;
+ * updates 'rec' as the driver updates its latest reading.
+ * returns 0 for a good reading, -EIO (checksum) or -ENODATA
+ */
+static int convert(int fd, struct dht22_record* rec, int* edges)
+{
+    struct dht22_edge           log[DHT22_EDGES_MAX];
+    struct dht22_decode_info    info;
+    uint64_t                    trigger_ns;
+    u8                          data[5];
+    int                         humidity;
+    int                         temperature;
+    int                         count;
+    int                         ret;
+
+    trigger_ns = now_ns();
+    if (line_config(fd, GPIO_V2_LINE_FLAG_OUTPUT, 0)) {
+        perror("start pulse");
+        count = 0;
+    }
+    else {
+        sleep_until(trigger_ns + (uint64_t)START_PULSE_NS * opt.slow);
+        count = capture(fd, log, trigger_ns);
+    }
+    *edges = count;
+
+    ret = dht22_decode_edges(log, count < DHT22_EDGES_MAX ?
+                                  count : DHT22_EDGES_MAX, data, &info);
+
+    humidity    = (data[0] << 8) | data[1];
+    temperature = (data[2] << 8) | data[3];
+    /* sign bit is not 2's complement */
+    if (data[2] & 0x80)
+        temperature = -(temperature & 0x7FFF);
+
+    if (0 == ret) {
+        rec->seq         += 1;
+        rec->timestamp_ns = now_ns();
+        rec->humidity     = humidity;
+        rec->temperature  = temperature;
+        rec->status       = DHT22_STATUS_OK;
+    }
+    else
+        rec->status = -EIO == ret ? DHT22_STATUS_CRC_ERROR :
+                                    DHT22_STATUS_INCOMPLETE;
+    return ret;
+}
+
+/*
+ * release the bus with both edges detected, and log the events until
+ * DHT22 releases it after the last bit, or the window is over; the
+ * first delta is from 'trigger_ns', like the driver's edge log, so the
+ * decoder skips the start pulse. returns the number of edges
+ */
+static int capture(int fd, struct dht22_edge* log, uint64_t trigger_ns)
+{
+    struct gpio_v2_line_event   ev[EVENT_BATCH];
+    uint64_t                    deadline;
+    uint64_t                    prev = trigger_ns;
+    int                         level = 0;
+    int                         n = 0;
+
+    if (line_config(fd, GPIO_V2_LINE_FLAG_INPUT |
+                        GPIO_V2_LINE_FLAG_EDGE_RISING |
+                        GPIO_V2_LINE_FLAG_EDGE_FALLING, 0)) {
+        perror("release");
+        return 0;
+    }
+    deadline = now_ns() + (uint64_t)CAPTURE_WINDOW_NS * opt.slow;
+
+    for (;;) {
+        struct pollfd   pfd = { .fd = fd, .events = POLLIN };
+        uint64_t        now = now_ns();
+        uint64_t        wait;
+        struct timespec ts;
+        ssize_t         len;
+        int             i;
+
+        if (now >= deadline)
+            break;
+        wait = deadline - now;
+        /* HIGH after enough edges: the frame may be complete */
+        if (level && n >= DHT22_EDGES_MIN &&
+            wait > (uint64_t)FRAME_END_NS * opt.slow)
+            wait = (uint64_t)FRAME_END_NS * opt.slow;
+        ts.tv_sec  = wait / NSEC_PER_SEC;
+        ts.tv_nsec = wait % NSEC_PER_SEC;
+
+        if (ppoll(&pfd, 1, &ts, NULL) <= 0) {
+            if (level && n >= DHT22_EDGES_MIN)
+                break;
+            continue;
+        }
+
+        len = read(fd, ev, sizeof(ev));
+        if (len < 0)
+            break;
+        for (i = 0; i < (int)(len / sizeof(ev[0])); ++i) {
+            uint64_t delta;
+
+            /* left in the queue by the previous conversion */
+            if (ev[i].timestamp_ns < prev)
+                continue;
+            delta = ev[i].timestamp_ns - prev;
+            level = GPIO_V2_LINE_EVENT_RISING_EDGE == ev[i].id;
+            dht22_log_edge(log, n++, delta / opt.slow, level);
+            prev = ev[i].timestamp_ns;
+        }
+    }
+
+    /* released until the next trigger, no more events */
+    line_config(fd, GPIO_V2_LINE_FLAG_INPUT, 0);
+    drain(fd);
+    return n;
+}
+
+/* drop events still queued */
+static void drain(int fd)
+{
+    struct gpio_v2_line_event   ev[EVENT_BATCH];
+    struct pollfd               pfd = { .fd = fd, .events = POLLIN };
+
+    while (poll(&pfd, 1, 0) > 0 && read(fd, ev, sizeof(ev)) > 0)
+        ;
+}
+
+static int socket_init(const char* path)
+{
+    struct sockaddr_un  addr;
+    int                 sock;
+
+    sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (sock < 0) {
+        perror("socket");
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    unlink(path);
+    if (bind(sock, (struct sockaddr*)&addr, sizeof(addr)) ||
+        listen(sock, CLIENTS_MAX)) {
+        perror(path);
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+/* 'latest' is NULL until the first conversion */
+static void socket_accept(int sock, const struct dht22_record* latest)
+{
+    int fd = accept4(sock, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+    if (fd < 0)
+        return;
+    if (nclients >= CLIENTS_MAX) {
+        close(fd);
+        return;
+    }
+
+    /* the latest to this client only, the others have it already */
+    if (latest &&
+        send(fd, latest, sizeof(*latest), MSG_DONTWAIT) != sizeof(*latest)) {
+        close(fd);
+        return;
+    }
+    clients[nclients++] = fd;
+}
+
+/*
+ * one record to every client; one whose queue is full (or gone) is
+ * dropped, never waited for
+ */
+static void socket_publish(const struct dht22_record* rec)
+{
+    int i = 0;
+
+    while (i < nclients) {
+        if (send(clients[i], rec, sizeof(*rec), MSG_DONTWAIT) ==
+            sizeof(*rec)) {
+            ++i;
+            continue;
+        }
+        close(clients[i]);
+        clients[i] = clients[--nclients];
+    }
+}
+
+static struct dht22_shm* shm_init(const char* path)
+{
+    struct dht22_shm*   shm;
+    int                 fd;
+
+    fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0 || ftruncate(fd, sizeof(*shm))) {
+        perror(path);
+        return NULL;
+    }
+
+    shm = mmap(NULL, sizeof(*shm), PROT_READ | PROT_WRITE, MAP_SHARED,
+               fd, 0);
+    close(fd);
+    if (MAP_FAILED == shm) {
+        perror("mmap");
+        return NULL;
+    }
+    return shm;
+}
+
+/*
+ * same protocol as the driver's page, for dht22_shm_read():
+ * seq is odd while the rest is written
+ */
+static void shm_publish(struct dht22_shm* shm, const struct dht22_record* rec)
+{
+    __atomic_store_n(&shm->seq, shm->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    shm->count       += 1;
+    shm->timestamp_ns = rec->timestamp_ns;
+    shm->humidity     = rec->humidity;
+    shm->temperature  = rec->temperature;
+    __atomic_store_n(&shm->seq, shm->seq + 1, __ATOMIC_RELEASE);
+}
+
+/* as the driver, "-0.5" for -5 */
+static void sprint_tenths(char* buf, int data)
+{
+    sprintf(buf, "%s%d.%d", (data < 0 && data > -10) ? "-" : "",
+                            data / 10, abs(data) % 10);
+}
+
+/* the clock of the GPIO edge events */
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static void sleep_until(uint64_t ns)
+{
+    struct timespec ts = { ns / NSEC_PER_SEC, ns % NSEC_PER_SEC };
+
+    while (EINTR == clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL)
+           && !stop)
+        ;
+}
+
+static void on_signal(int sig)
+{
+    (void)sig;
+    stop = 1;
+}
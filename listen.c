@@ -0,0 +1,318 @@
+/*
+ * subscriber of the driver's generic netlink family "dht22" (see
+ * dht22_user.h): prints every conversion of every sensor as multicast by
+ * the driver, one line each; no libnl needed
+ *
+ * usage: listen [-s sensor] [-n readings] [-v]
+ *        listen -g sensor
+ *
+ * -s prints only readings of sensor <n>, -n exits after that many,
+ * -v also prints how many readings came in each datagram;
+ * -g asks for the latest reading of sensor <n> and exits
+ *
+ * output: "<sensor> <seq> <timestamp sec> <humidity> <temperature> <status>"
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/genetlink.h>
+#include "dht22_user.h"
+
+#define BUF_SIZE        65536
+#define SIZEOF(array)   (sizeof(array)/sizeof(array[0]))
+
+#define GENLMSG_DATA(nlh)   ((char*)NLMSG_DATA(nlh) + GENL_HDRLEN)
+#define GENLMSG_LEN(nlh)    ((int)NLMSG_PAYLOAD(nlh, GENL_HDRLEN))
+#define NLA_DATA(nla)       ((char*)(nla) + NLA_HDRLEN)
+
+struct reading_t {
+    __u32   sensor;
+    struct dht22_record rec;
+};
+
+static const char* status_names[] = { "ok", "crc_error", "incomplete" };
+
+static int  open_socket(void);
+static int  send_request(int fd, __u16 type, __u8 cmd, __u16 attr,
+                         const void* data, int len);
+static int  resolve_family(int fd, __u16* family, __u32* group);
+static void parse_attrs(const char* data, int len,
+                        const struct nlattr** tb, int max);
+static int  parse_reading(const struct nlmsghdr* nlh, struct reading_t* r);
+static void print_reading(const struct reading_t* r);
+static void sprint_tenths(char* buf, int data);
+
+int main(int argc, char* argv[])
+{
+    static char         buf[BUF_SIZE];
+    int                 sensor = -1;
+    int                 count = 0;
+    int                 get = -1;
+    int                 verbose = 0;
+    int                 received = 0;
+    __u16               family;
+    __u32               group;
+    int                 fd;
+    int                 opt;
+
+    while (-1 != (opt = getopt(argc, argv, "s:n:g:v"))) {
+        switch (opt) {
+        case 's': sensor  = atoi(optarg); break;
+        case 'n': count   = atoi(optarg); break;
+        case 'g': get     = atoi(optarg); break;
+        case 'v': verbose = 1; break;
+        default:
+            fprintf(stderr, "usage: %s [-s sensor] [-n readings] [-v]\n"
+                            "       %s -g sensor\n", argv[0], argv[0]);
+            return 2;
+        }
+    }
+
+    fd = open_socket();
+    if (fd < 0)
+        return 1;
+
+    if (resolve_family(fd, &family, &group)) {
+        fprintf(stderr, "generic netlink family \"%s\" not found, "
+                        "is dht22.ko loaded?\n", DHT22_GENL_NAME);
+        return 1;
+    }
+
+    if (get >= 0) {
+        __u32 id = get;
+
+        if (send_request(fd, family, DHT22_CMD_GET, DHT22_A_SENSOR,
+                         &id, sizeof(id)))
+            return 1;
+    }
+    else if (setsockopt(fd, SOL_NETLINK, NETLINK_ADD_MEMBERSHIP,
+                        &group, sizeof(group))) {
+        perror("NETLINK_ADD_MEMBERSHIP");
+        return 1;
+    }
+
+    for (;;) {
+        const struct nlmsghdr*  nlh;
+        int                     len;
+        int                     batch = 0;
+
+        len = recv(fd, buf, sizeof(buf), 0);
+        if (len < 0) {
+            /* too slow, the kernel dropped some; go on */
+            if (ENOBUFS == errno) {
+                fprintf(stderr, "readings lost\n");
+                continue;
+            }
+            perror("recv");
+            return 1;
+        }
+
+        for (nlh = (const struct nlmsghdr*)buf; NLMSG_OK(nlh, len);
+             nlh = NLMSG_NEXT(nlh, len)) {
+            struct reading_t r;
+
+            if (NLMSG_ERROR == nlh->nlmsg_type) {
+                const struct nlmsgerr* err = NLMSG_DATA(nlh);
+
+                fprintf(stderr, "sensor %d: %s\n", get, strerror(-err->error));
+                return 1;
+            }
+            if (family != nlh->nlmsg_type || parse_reading(nlh, &r))
+                continue;
+
+            ++batch;
+            if (sensor >= 0 && (__u32)sensor != r.sensor)
+                continue;
+            print_reading(&r);
+            ++received;
+            if (get >= 0 || (count > 0 && received >= count))
+                return 0;
+        }
+
+        if (verbose)
+            printf("# %d reading(s) in one datagram\n", batch);
+        fflush(stdout);
+    }
+}
+
+static int open_socket(void)
+{
+    struct sockaddr_nl  addr;
+    int                 fd;
+
+    fd = socket(AF_NETLINK, SOCK_RAW, NETLINK_GENERIC);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.nl_family = AF_NETLINK;
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr))) {
+        perror("bind");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/*
+ * one generic netlink request with a single attribute
+ */
+static int send_request(int fd, __u16 type, __u8 cmd, __u16 attr,
+                        const void* data, int len)
+{
+    struct {
+        struct nlmsghdr     nlh;
+        struct genlmsghdr   genl;
+        char                attrs[256];
+    } req;
+    struct nlattr*      nla;
+
+    memset(&req, 0, sizeof(req));
+    req.nlh.nlmsg_type  = type;
+    req.nlh.nlmsg_flags = NLM_F_REQUEST;
+    req.nlh.nlmsg_seq   = 1;
+    req.genl.cmd        = cmd;
+    req.genl.version    = 1;
+
+    nla = (struct nlattr*)req.attrs;
+    nla->nla_type = attr;
+    nla->nla_len  = NLA_HDRLEN + len;
+    memcpy(NLA_DATA(nla), data, len);
+
+    req.nlh.nlmsg_len = NLMSG_LENGTH(GENL_HDRLEN) + NLA_ALIGN(nla->nla_len);
+    if (send(fd, &req, req.nlh.nlmsg_len, 0) < 0) {
+        perror("send");
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * id of the family and of its multicast group, from the controller
+ */
+static int resolve_family(int fd, __u16* family, __u32* group)
+{
+    static char             buf[BUF_SIZE];
+    const struct nlattr*    tb[CTRL_ATTR_MAX + 1];
+    const struct nlmsghdr*  nlh = (const struct nlmsghdr*)buf;
+    const struct nlattr*    grp;
+    int                     len;
+    int                     rem;
+
+    if (send_request(fd, GENL_ID_CTRL, CTRL_CMD_GETFAMILY,
+                     CTRL_ATTR_FAMILY_NAME, DHT22_GENL_NAME,
+                     sizeof(DHT22_GENL_NAME)))
+        return -1;
+
+    len = recv(fd, buf, sizeof(buf), 0);
+    if (len < 0 || !NLMSG_OK(nlh, len) || NLMSG_ERROR == nlh->nlmsg_type)
+        return -1;
+
+    parse_attrs(GENLMSG_DATA(nlh), GENLMSG_LEN(nlh), tb, CTRL_ATTR_MAX);
+    if (!tb[CTRL_ATTR_FAMILY_ID] || !tb[CTRL_ATTR_MCAST_GROUPS])
+        return -1;
+    *family = *(const __u16*)NLA_DATA(tb[CTRL_ATTR_FAMILY_ID]);
+
+    /* nested: one nested entry for each group */
+    grp = (const struct nlattr*)NLA_DATA(tb[CTRL_ATTR_MCAST_GROUPS]);
+    rem = tb[CTRL_ATTR_MCAST_GROUPS]->nla_len - NLA_HDRLEN;
+    while (rem >= NLA_HDRLEN && grp->nla_len >= NLA_HDRLEN &&
+           grp->nla_len <= rem) {
+        const struct nlattr* gtb[CTRL_ATTR_MCAST_GRP_MAX + 1];
+
+        parse_attrs(NLA_DATA(grp), grp->nla_len - NLA_HDRLEN, gtb,
+                    CTRL_ATTR_MCAST_GRP_MAX);
+        if (gtb[CTRL_ATTR_MCAST_GRP_NAME] && gtb[CTRL_ATTR_MCAST_GRP_ID] &&
+            0 == strcmp(NLA_DATA(gtb[CTRL_ATTR_MCAST_GRP_NAME]),
+                        DHT22_GENL_MCGRP)) {
+            *group = *(const __u32*)NLA_DATA(gtb[CTRL_ATTR_MCAST_GRP_ID]);
+            return 0;
+        }
+        rem -= NLA_ALIGN(grp->nla_len);
+        grp  = (const struct nlattr*)((const char*)grp +
+                                      NLA_ALIGN(grp->nla_len));
+    }
+    return -1;
+}
+
+/*
+ * tb[type] points to the last attribute of each type up to 'max',
+ * NULL if absent
+ */
+static void parse_attrs(const char* data, int len,
+                        const struct nlattr** tb, int max)
+{
+    const struct nlattr* nla = (const struct nlattr*)data;
+
+    memset(tb, 0, sizeof(*tb) * (max + 1));
+    while (len >= NLA_HDRLEN && nla->nla_len >= NLA_HDRLEN &&
+           nla->nla_len <= len) {
+        int type = nla->nla_type & NLA_TYPE_MASK;
+
+        if (type <= max)
+            tb[type] = nla;
+        len -= NLA_ALIGN(nla->nla_len);
+        nla  = (const struct nlattr*)((const char*)nla +
+                                      NLA_ALIGN(nla->nla_len));
+    }
+}
+
+static int parse_reading(const struct nlmsghdr* nlh, struct reading_t* r)
+{
+    const struct genlmsghdr*    genl = NLMSG_DATA(nlh);
+    const struct nlattr*        tb[DHT22_A_MAX + 1];
+    int                         i;
+    static const int            required[] = {
+        DHT22_A_SENSOR, DHT22_A_SEQ, DHT22_A_TIMESTAMP,
+        DHT22_A_HUMIDITY, DHT22_A_TEMPERATURE, DHT22_A_STATUS
+    };
+
+    if (DHT22_CMD_READING != genl->cmd)
+        return -1;
+
+    parse_attrs(GENLMSG_DATA(nlh), GENLMSG_LEN(nlh), tb, DHT22_A_MAX);
+    for (i = 0; i < (int)SIZEOF(required); ++i) {
+        if (NULL == tb[required[i]])
+            return -1;
+    }
+
+    memset(r, 0, sizeof(*r));
+    memcpy(&r->sensor, NLA_DATA(tb[DHT22_A_SENSOR]), sizeof(__u32));
+    memcpy(&r->rec.seq, NLA_DATA(tb[DHT22_A_SEQ]), sizeof(__u64));
+    memcpy(&r->rec.timestamp_ns, NLA_DATA(tb[DHT22_A_TIMESTAMP]),
+           sizeof(__u64));
+    memcpy(&r->rec.humidity, NLA_DATA(tb[DHT22_A_HUMIDITY]), sizeof(__s32));
+    memcpy(&r->rec.temperature, NLA_DATA(tb[DHT22_A_TEMPERATURE]),
+           sizeof(__s32));
+    memcpy(&r->rec.status, NLA_DATA(tb[DHT22_A_STATUS]), sizeof(__u32));
+    return 0;
+}
+
+static void print_reading(const struct reading_t* r)
+{
+    char humidity[16];
+    char temperature[16];
+
+    sprint_tenths(humidity, r->rec.humidity);
+    sprint_tenths(temperature, r->rec.temperature);
+    printf("%u %llu %llu.%06llu %s %s %s\n", r->sensor,
+           (unsigned long long)r->rec.seq,
+           (unsigned long long)(r->rec.timestamp_ns / 1000000000),
+           (unsigned long long)(r->rec.timestamp_ns % 1000000000 / 1000),
+           humidity, temperature,
+           r->rec.status < SIZEOF(status_names) ?
+           status_names[r->rec.status] : "?");
+}
+
+/* as the driver, "-0.5" for -5 */
+static void sprint_tenths(char* buf, int data)
+{
+    sprintf(buf, "%s%d.%d", (data < 0 && data > -10) ? "-" : "",
+                            data / 10, abs(data) % 10);
+}
@@ -1,80 +1,459 @@
+/*
+ * load generator for the read side of the DHT22 driver:
+ * N reader threads (or processes) reading the latest reading of one
+ * sensor, to see how many readers a board's sensors can serve
+ *
+ * usage: poll [-i sysfs|dev|h|t] [-w busy|poll] [-t readers] [-P]
+ *             [-s sensor] [-d seconds] [-S] [-u stub_ms]
+ *
+ *  -i  interface: /sys/kernel/dht22/sensor<n>/reading (default),
+ *      /dev/dht22_reading:<n> in binary mode, or the text-mode nodes
+ *      /dev/dht22:<2n> (h, humidity) and /dev/dht22:<2n+1> (t,
+ *      temperature), read again from offset 0 each time
+ *  -w  busy: read in a loop (default); poll: wait for each new reading
+ *  -t  number of readers, default 4
+ *  -P  readers are processes, not threads
+ *  -s  sensor index, default 0
+ *  -d  duration in seconds, default 10
+ *  -S  stub device: no driver needed, a writer thread publishes a new
+ *      reading every 'stub_ms' (default 100) to a file, and notifies
+ *      each reader through a pipe; also used if the sensor isn't there
+ *
+ * reports read throughput, read() latency percentiles and, in poll mode,
+ * latency from a new reading to the reader's wakeup
+ */
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <poll.h>
 #include <pthread.h>
 #include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <sys/wait.h>
+#include "dht22_user.h"
 
 #define BUF_MAX         64
-#define SIZEOF(array)   (sizeof(array)/sizeof(array[0]))
+#define READERS_MAX     256
+#define SAMPLES_MAX     100000      /* read latencies kept per reader */
+#define WAKEUPS_MAX     10000
 
-struct thread_param_t {
-    char    path[BUF_MAX];
-    char    name[BUF_MAX];
-    int     time_out;
+enum iface_t { IFACE_SYSFS, IFACE_DEV, IFACE_HUMIDITY, IFACE_TEMPERATURE };
+enum wait_t  { WAIT_BUSY, WAIT_POLL };
+
+/*
+ * per reader, in memory shared with reader processes
+ */
+struct reader_t {
+    uint64_t    reads;
+    uint64_t    errors;
+    uint64_t    wakeups;
+    uint32_t    nsamples;
+    uint32_t    nwakes;
+    uint32_t    samples[SAMPLES_MAX];   /* read() latency, ns */
+    uint32_t    wakes[WAKEUPS_MAX];     /* new reading to wakeup, ns */
+    int         notify_fd;              /* stub: read end of the pipe */
+};
+
+struct shared_t {
+    volatile int        stop;
+    struct reader_t     readers[];
+};
+
+struct config_t {
+    enum iface_t    iface;
+    enum wait_t     wait;
+    int             num_readers;
+    int             processes;
+    int             sensor;
+    int             seconds;
+    int             stub;
+    int             stub_ms;
+    char            path[BUF_MAX];      /* sysfs attribute or device node */
+    char            dev_path[BUF_MAX];  /* for mmap, timestamp in text modes */
+    char            stub_path[BUF_MAX];
+    int             notify_wr[READERS_MAX];
+};
+
+static struct config_t      config = {
+    .iface          = IFACE_SYSFS,
+    .wait           = WAIT_BUSY,
+    .num_readers    = 4,
+    .sensor         = 0,
+    .seconds        = 10,
+    .stub_ms        = 100,
+};
+static struct shared_t*     shared;
+static const char*          iface_names[] = {
+    "sysfs", "char device", "humidity node", "temperature node"
 };
 
-void* thread_work(void*);
+static void*    reader_work(void* arg);
+static void*    stub_writer(void* arg);
+static int      stub_init(void);
+static void     report(void);
+static uint64_t now_ns(void);
 
 int main(int argc, char* argv[])
 {
-    int                     i;
-    pthread_t               threads[2];
-    struct thread_param_t   params [2] = {  {
-            .path = "/sys/kernel/dht22/temperature",
-            .name = "temperature",
-            .time_out = 20000, /* ms */
-        }, {
-            .path = "/sys/kernel/dht22/humidity",
-            .name = "humidity",
-            .time_out = 20000, /* ms */
+    pthread_t   threads[READERS_MAX];
+    pthread_t   writer;
+    pid_t       pids[READERS_MAX];
+    size_t      size;
+    int         opt;
+    int         i;
+
+    while (-1 != (opt = getopt(argc, argv, "i:w:t:Ps:d:Su:"))) {
+        switch (opt) {
+        case 'i': config.iface = !strcmp(optarg, "dev") ? IFACE_DEV :
+                                 !strcmp(optarg, "h")   ? IFACE_HUMIDITY :
+                                 !strcmp(optarg, "t")   ? IFACE_TEMPERATURE :
+                                                          IFACE_SYSFS;
+                  break;
+        case 'w': config.wait        = strcmp(optarg, "poll") ? WAIT_BUSY :
+                                                                WAIT_POLL;
+                  break;
+        case 't': config.num_readers = atoi(optarg); break;
+        case 'P': config.processes   = 1; break;
+        case 's': config.sensor      = atoi(optarg); break;
+        case 'd': config.seconds     = atoi(optarg); break;
+        case 'S': config.stub        = 1; break;
+        case 'u': config.stub_ms     = atoi(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [-i sysfs|dev|h|t] [-w busy|poll] "
+                    "[-t readers] [-P] [-s sensor] [-d seconds] [-S] "
+                    "[-u stub_ms]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (config.num_readers < 1 || config.num_readers > READERS_MAX) {
+        printf("1 to %d readers\n", READERS_MAX);
+        return 2;
+    }
+
+    if (IFACE_SYSFS == config.iface)
+        snprintf(config.path, BUF_MAX, "/sys/kernel/dht22/sensor%d/reading",
+                 config.sensor);
+    else if (IFACE_DEV == config.iface)
+        snprintf(config.path, BUF_MAX, "/dev/dht22_reading:%d", config.sensor);
+    else
+        snprintf(config.path, BUF_MAX, "/dev/dht22:%d", 2 * config.sensor +
+                 (IFACE_TEMPERATURE == config.iface));
+    snprintf(config.dev_path, BUF_MAX, "/dev/dht22_reading:%d", config.sensor);
+
+    if (!config.stub && -1 == access(config.path, R_OK)) {
+        printf("Can't read %s, using the stub device\n", config.path);
+        config.stub = 1;
+    }
+
+    size   = sizeof(*shared) + config.num_readers * sizeof(struct reader_t);
+    shared = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (MAP_FAILED == shared) {
+        printf("Out of memory\n");
+        return 2;
+    }
+
+    if (config.stub) {
+        if (stub_init())
+            return 2;
+        pthread_create(&writer, NULL, stub_writer, NULL);
+    }
+
+    printf("%d reader %s, %s%s, %s mode, %d sec\n", config.num_readers,
+           config.processes ? "processes" : "threads",
+           config.stub ? "stub " : "", iface_names[config.iface],
+           WAIT_BUSY == config.wait ? "busy-read" : "poll", config.seconds);
+
+    for (i = 0; i < config.num_readers; ++i) {
+        if (!config.processes)
+            pthread_create(&threads[i], NULL, reader_work, &shared->readers[i]);
+        else if (0 == (pids[i] = fork())) {
+            reader_work(&shared->readers[i]);
+            _exit(0);
         }
-    };
+    }
+
+    sleep(config.seconds);
+    shared->stop = 1;
+
+    for (i = 0; i < config.num_readers; ++i) {
+        if (!config.processes)
+            pthread_join(threads[i], NULL);
+        else if (pids[i] > 0)
+            waitpid(pids[i], NULL, 0);
+    }
+    if (config.stub) {
+        pthread_join(writer, NULL);
+        unlink(config.stub_path);
+    }
+
+    report();
+    return 0;
+}
+
+/*
+ * reservoir sampling, keeps 'max' samples out of 'seen'
+ */
+static void add_sample(uint32_t* samples, uint32_t* n, uint32_t max,
+                       uint64_t seen, uint64_t value, unsigned* rnd)
+{
+    uint32_t v = value > UINT32_MAX ? UINT32_MAX : value;
+
+    if (*n < max)
+        samples[(*n)++] = v;
+    else {
+        uint64_t k = ((uint64_t)rand_r(rnd) << 31 | rand_r(rnd)) % seen;
+
+        if (k < max)
+            samples[k] = v;
+    }
+}
+
+/*
+ * one read of the latest reading, its timestamp if known
+ */
+static int read_once(int fd, uint64_t* timestamp_ns,
+                     const volatile struct dht22_shm* shm)
+{
+    struct dht22_record rec;
+    char                buf[BUF_MAX];
 
-    for (i = 0; i < SIZEOF(threads); ++i) 
-        pthread_create(&threads[i], NULL, thread_work, (void*)&params[i]);
+    /* binary mode: each read() of the char device returns one record */
+    if (config.stub || IFACE_DEV == config.iface) {
+        if (sizeof(rec) != (config.stub ? pread(fd, &rec, sizeof(rec), 0) :
+                                          read(fd, &rec, sizeof(rec))))
+            return -1;
+        *timestamp_ns = rec.timestamp_ns;
+        return 0;
+    }
 
-    for (i = 0; i < SIZEOF(threads); ++i)
-        pthread_join(threads[i], NULL);
+    /* text: the sysfs attribute or /dev/dht22:<n>, again from offset 0 */
+    if (pread(fd, buf, sizeof(buf), 0) <= 0)
+        return -1;
+    if (shm) {
+        struct dht22_shm snap;
 
+        dht22_shm_read(shm, &snap);
+        *timestamp_ns = snap.timestamp_ns;
+    }
     return 0;
 }
 
-void* thread_work(void* arg)
+void* reader_work(void* arg)
+{
+    struct reader_t*            reader = arg;
+    const volatile struct dht22_shm* shm = NULL;
+    struct pollfd               pfd;
+    unsigned                    rnd = (unsigned)(uintptr_t)arg;
+    uint64_t                    timestamp_ns = 0;
+    int                         fd;
+
+    fd = open(config.stub ? config.stub_path : config.path, O_RDONLY);
+    if (-1 == fd) {
+        printf("Can't open %s\n", config.stub ? config.stub_path : config.path);
+        return NULL;
+    }
+    if (!config.stub && IFACE_DEV == config.iface &&
+        ioctl(fd, DHT22_IOC_SET_MODE, DHT22_MODE_BINARY)) {
+        printf("Can't set binary mode of %s\n", config.path);
+        close(fd);
+        return NULL;
+    }
+
+    /* timestamp of the latest reading, for text-mode pollers */
+    if (!config.stub && IFACE_DEV != config.iface && WAIT_POLL == config.wait) {
+        int dev = open(config.dev_path, O_RDONLY);
+
+        if (-1 != dev) {
+            shm = mmap(NULL, sizeof(*shm), PROT_READ, MAP_SHARED, dev, 0);
+            if (MAP_FAILED == shm)
+                shm = NULL;
+            close(dev);
+        }
+    }
+
+    pfd.fd     = config.stub ? reader->notify_fd : fd;
+    pfd.events = config.stub ? POLLIN :
+                 IFACE_SYSFS == config.iface ? POLLPRI | POLLERR : POLLIN;
+
+    /* the first read arms poll() of sysfs and of the char device */
+    read_once(fd, &timestamp_ns, shm);
+
+    while (!shared->stop) {
+        uint64_t woke = 0;
+        uint64_t notified_ns = 0;
+        uint64_t start;
+        uint64_t end;
+        int      ret;
+
+        if (WAIT_POLL == config.wait) {
+            ret = poll(&pfd, 1, 100);
+            if (ret <= 0)
+                continue;
+            woke = now_ns();
+            ++reader->wakeups;
+            /* stub: the writer sends the timestamp of each reading */
+            if (config.stub &&
+                sizeof(notified_ns) != read(reader->notify_fd, &notified_ns,
+                                            sizeof(notified_ns)))
+                notified_ns = 0;
+        }
+
+        start = now_ns();
+        ret   = read_once(fd, &timestamp_ns, shm);
+        end   = now_ns();
+        if (ret) {
+            ++reader->errors;
+            continue;
+        }
+        ++reader->reads;
+        add_sample(reader->samples, &reader->nsamples, SAMPLES_MAX,
+                   reader->reads, end - start, &rnd);
+
+        if (WAIT_POLL == config.wait) {
+            uint64_t ts = config.stub ? notified_ns : timestamp_ns;
+
+            if (ts && ts <= woke)
+                add_sample(reader->wakes, &reader->nwakes, WAKEUPS_MAX,
+                           reader->wakeups, woke - ts, &rnd);
+        }
+    }
+
+    if (shm)
+        munmap((void*)shm, sizeof(*shm));
+    close(fd);
+    return NULL;
+}
+
+/*
+ * a file holding one struct dht22_record, and a pipe per reader
+ */
+static int stub_init(void)
 {
-    struct thread_param_t   param;
-    struct pollfd           pfd = { .events = POLLPRI };
-    int                     ret = 1;
-    char                    buf[BUF_MAX];
-
-    memcpy((void*)&param, arg, sizeof(param));
-    while (1) {
-        /*
-         * open/close in loop is a must,
-         * or poll() won't be block
-         */
-        pfd.fd = open(param.path, O_RDONLY);
-        if (-1 == pfd.fd) {
-            printf("Can't open %s\n", param.path);
-            break;
+    struct dht22_record rec = { 0 };
+    int                 fd;
+    int                 i;
+
+    snprintf(config.stub_path, BUF_MAX, "/tmp/dht22_stub.XXXXXX");
+    fd = mkstemp(config.stub_path);
+    if (-1 == fd || sizeof(rec) != write(fd, &rec, sizeof(rec))) {
+        printf("Can't create the stub device\n");
+        return -1;
+    }
+    close(fd);
+
+    for (i = 0; i < config.num_readers; ++i) {
+        int p[2];
+
+        if (pipe2(p, O_NONBLOCK)) {
+            printf("Can't create pipe\n");
+            return -1;
         }
-        /*
-         * a dummy read is a must,
-         * or poll() won't be blocked
-         */
-        read(pfd.fd, buf, sizeof(buf));
-        ret = poll(&pfd, 1, param.time_out);
-        if (0 > ret) 
-            printf("poll error\n");
-        else if (0 == ret)
-            printf("poll timeout\n");
-        else
-            printf("%s: %s", param.name, buf);
-
-        close(pfd.fd);
+        shared->readers[i].notify_fd = p[0];
+        config.notify_wr[i] = p[1];
+    }
+    return 0;
+}
+
+void* stub_writer(void* arg)
+{
+    struct dht22_record rec = { 0 };
+    int                 fd = open(config.stub_path, O_WRONLY);
+    int                 i;
+
+    (void)arg;
+    while (!shared->stop) {
+        usleep(config.stub_ms * 1000);
+
+        rec.seq         += 1;
+        rec.timestamp_ns = now_ns();
+        rec.humidity     = 500 + rec.seq % 100;
+        rec.temperature  = 250 + rec.seq % 50;
+        pwrite(fd, &rec, sizeof(rec), 0);
+        for (i = 0; i < config.num_readers; ++i)
+            write(config.notify_wr[i], &rec.timestamp_ns,
+                  sizeof(rec.timestamp_ns));
     }
 
+    close(fd);
     return NULL;
 }
 
+static int cmp_u32(const void* a, const void* b)
+{
+    uint32_t x = *(const uint32_t*)a;
+    uint32_t y = *(const uint32_t*)b;
+
+    return x < y ? -1 : x > y;
+}
+
+/*
+ * p50/p99/p999 of the samples of all readers
+ */
+static void print_percentiles(const char* name, int wakes)
+{
+    uint32_t*   all;
+    uint64_t    n = 0;
+    int         i;
+
+    for (i = 0; i < config.num_readers; ++i)
+        n += wakes ? shared->readers[i].nwakes : shared->readers[i].nsamples;
+    if (0 == n) {
+        printf("%-22s no samples\n", name);
+        return;
+    }
+
+    all = malloc(n * sizeof(*all));
+    if (NULL == all)
+        return;
+    n = 0;
+    for (i = 0; i < config.num_readers; ++i) {
+        const struct reader_t* r = &shared->readers[i];
+
+        memcpy(all + n, wakes ? r->wakes : r->samples,
+               (wakes ? r->nwakes : r->nsamples) * sizeof(*all));
+        n += wakes ? r->nwakes : r->nsamples;
+    }
+    qsort(all, n, sizeof(*all), cmp_u32);
+
+    printf("%-22s p50 %.1fus  p99 %.1fus  p999 %.1fus  max %.1fus\n", name,
+           all[n * 50 / 100] / 1e3, all[n * 99 / 100] / 1e3,
+           all[n * 999 / 1000] / 1e3, all[n - 1] / 1e3);
+    free(all);
+}
+
+static void report(void)
+{
+    uint64_t reads = 0;
+    uint64_t errors = 0;
+    uint64_t wakeups = 0;
+    int      i;
+
+    for (i = 0; i < config.num_readers; ++i) {
+        reads   += shared->readers[i].reads;
+        errors  += shared->readers[i].errors;
+        wakeups += shared->readers[i].wakeups;
+    }
+
+    printf("reads %llu (%.0f/sec), errors %llu\n", (unsigned long long)reads,
+           (double)reads / config.seconds, (unsigned long long)errors);
+    print_percentiles("read latency:", 0);
+    if (WAIT_POLL == config.wait) {
+        printf("wakeups %llu\n", (unsigned long long)wakeups);
+        print_percentiles("notification latency:", 1);
+    }
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
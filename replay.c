@@ -0,0 +1,361 @@
+/*
+ * replay of DHT22 edge logs through the driver's decoder (dht22_decode.c),
+ * on any Linux box; for regression tests and benchmarks of the decoder
+ *
+ * usage: replay [-n rounds] [-s synthetic] [-j jitter_us] [-d drops]
+ *               [-u duplicates] [-r seed] [-v] [trace.txt ...]
+ *
+ * trace.txt is in the format of DOC/dht22_interrupts_*.txt (or
+ * /sys/kernel/debug/dht22/sensor<n>/edges); if it also has the lines
+ * "humidity = ", "temperature = " and "crc ... correct", the result
+ * must match them.
+ * synthetic traces are random readings, with DHT22's timing spread, plus
+ * 'jitter_us' of IRQ latency on each edge, 'drops' lost edges and
+ * 'duplicates' spurious edges.
+ *
+ * exits 1 if a trace with known result fails, or any wrong value passes
+ * the checksum
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include "dht22_decode.h"
+
+#define LINE_MAX_LEN    256
+#define SIZEOF(array)   (sizeof(array)/sizeof(array[0]))
+
+struct trace_t {
+    char                name[LINE_MAX_LEN];
+    struct dht22_edge   edges[DHT22_EDGES_MAX];
+    int                 count;
+    int                 recorded;       /* from a file, not synthetic */
+    int                 known;          /* expected values below are valid */
+    int                 humidity;       /* 0.1 % */
+    int                 temperature;    /* 0.1 °C */
+};
+
+enum result_t { RES_OK, RES_WRONG, RES_CRC, RES_INCOMPLETE, RES_FAILED, RES_RESULTS };
+
+static const char* result_names[RES_RESULTS] = {
+    "ok", "WRONG", "crc_error", "incomplete", "FAILED"
+};
+
+static int  load_trace(const char* path, struct trace_t* trace);
+static void make_trace(struct trace_t* trace, int jitter_us, int drops,
+                       int duplicates);
+static int  decode(const struct trace_t* trace, int* humidity,
+                   int* temperature, struct dht22_decode_info* info);
+static enum result_t check(const struct trace_t* trace, int ret,
+                           int humidity, int temperature);
+static int  tenths(const char* s);
+static u64  now_ns(void);
+
+int main(int argc, char* argv[])
+{
+    struct trace_t*     traces;
+    int                 num_traces = 0;
+    int                 rounds = 1000;
+    int                 synthetic = 0;
+    int                 jitter_us = 0;
+    int                 drops = 0;
+    int                 duplicates = 0;
+    int                 verbose = 0;
+    unsigned            seed = 1;
+    int                 results[RES_RESULTS] = { 0 };
+    int                 opt;
+    int                 i;
+    int                 r;
+    u64                 start;
+    u64                 elapsed;
+    volatile int        sink = 0;
+
+    while (-1 != (opt = getopt(argc, argv, "n:s:j:d:u:r:v"))) {
+        switch (opt) {
+        case 'n': rounds     = atoi(optarg); break;
+        case 's': synthetic  = atoi(optarg); break;
+        case 'j': jitter_us  = atoi(optarg); break;
+        case 'd': drops      = atoi(optarg); break;
+        case 'u': duplicates = atoi(optarg); break;
+        case 'r': seed       = strtoul(optarg, NULL, 0); break;
+        case 'v': verbose    = 1; break;
+        default:
+            fprintf(stderr, "usage: %s [-n rounds] [-s synthetic] "
+                    "[-j jitter_us] [-d drops] [-u duplicates] [-r seed] "
+                    "[-v] [trace.txt ...]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    traces = calloc(argc - optind + synthetic, sizeof(*traces));
+    if (NULL == traces) {
+        printf("Out of memory\n");
+        return 2;
+    }
+
+    for (i = optind; i < argc; ++i) {
+        if (0 == load_trace(argv[i], &traces[num_traces]))
+            ++num_traces;
+        else
+            printf("Can't read %s\n", argv[i]);
+    }
+
+    srand(seed);
+    for (i = 0; i < synthetic; ++i) {
+        snprintf(traces[num_traces].name, LINE_MAX_LEN, "synthetic %d", i);
+        make_trace(&traces[num_traces++], jitter_us, drops, duplicates);
+    }
+
+    if (0 == num_traces) {
+        printf("No trace to replay\n");
+        return 2;
+    }
+
+    /* correctness */
+    for (i = 0; i < num_traces; ++i) {
+        struct dht22_decode_info info;
+        enum result_t            res;
+        int                      humidity;
+        int                      temperature;
+        int                      ret;
+
+        ret = decode(&traces[i], &humidity, &temperature, &info);
+        res = check(&traces[i], ret, humidity, temperature);
+        ++results[res];
+
+        if (verbose || i < argc - optind || RES_WRONG == res || RES_FAILED == res)
+            printf("%s: %s %d.%d%% %s%d.%dC (%d edges, %d bits, "
+                   "%d repaired, %d candidates, LOW %uns, threshold %uns)%s\n",
+                   traces[i].name, result_names[res],
+                   humidity / 10, humidity % 10,
+                   temperature < 0 ? "-" : "",
+                   abs(temperature) / 10, abs(temperature) % 10,
+                   traces[i].count, info.bits, info.repaired, info.candidates,
+                   info.low_ns, info.threshold_ns,
+                   traces[i].known ? "" : " (no reference)");
+    }
+
+    printf("\n%d traces:", num_traces);
+    for (r = 0; r < RES_RESULTS; ++r)
+        printf(" %s %d", result_names[r], results[r]);
+    printf("\n");
+
+    /* throughput */
+    start = now_ns();
+    for (r = 0; r < rounds; ++r) {
+        for (i = 0; i < num_traces; ++i) {
+            struct dht22_decode_info info;
+            u8                       data[5];
+
+            sink += dht22_decode_edges(traces[i].edges, traces[i].count,
+                                       data, &info);
+        }
+    }
+    elapsed = now_ns() - start;
+
+    if (rounds > 0 && elapsed > 0)
+        printf("%d decodes in %.3f ms: %.0f decodes/sec, %.0f ns/decode\n",
+               rounds * num_traces, elapsed / 1e6,
+               1e9 * rounds * num_traces / elapsed,
+               (double)elapsed / rounds / num_traces);
+
+    free(traces);
+    return results[RES_WRONG] || results[RES_FAILED] ? 1 : 0;
+}
+
+/*
+ * "....interrupt 5,  value(1), time(53)", time in usec since
+ * the previous edge; anything else is a comment
+ */
+static int load_trace(const char* path, struct trace_t* trace)
+{
+    FILE*   fp = fopen(path, "r");
+    char    line[LINE_MAX_LEN];
+    int     has_humidity = 0;
+    int     has_temperature = 0;
+    int     correct = 0;
+
+    if (NULL == fp)
+        return -1;
+
+    memset(trace, 0, sizeof(*trace));
+    snprintf(trace->name, sizeof(trace->name), "%s", path);
+
+    while (fgets(line, sizeof(line), fp)) {
+        const char* p;
+        int         index;
+        int         level;
+        unsigned    usec;
+
+        if ((p = strstr(line, "interrupt")) &&
+            3 == sscanf(p, "interrupt %d, value(%d), time(%u)",
+                        &index, &level, &usec)) {
+            dht22_log_edge(trace->edges, trace->count,
+                           (u64)usec * 1000, level);
+            ++trace->count;
+        }
+        else if (0 == strncmp(line, "humidity", 8) && (p = strchr(line, '='))) {
+            trace->humidity = tenths(p + 1);
+            has_humidity = 1;
+        }
+        else if (0 == strncmp(line, "temperature", 11) &&
+                 (p = strchr(line, '='))) {
+            trace->temperature = tenths(p + 1);
+            has_temperature = 1;
+        }
+        else if (0 == strncmp(line, "crc", 3) && strstr(line, "correct"))
+            correct = 1;
+    }
+    fclose(fp);
+
+    if (trace->count > DHT22_EDGES_MAX)
+        trace->count = DHT22_EDGES_MAX;
+    trace->recorded = 1;
+    trace->known    = has_humidity && has_temperature && correct;
+    return 0;
+}
+
+static int rand_range(int lo, int hi)
+{
+    return lo + rand() % (hi - lo + 1);
+}
+
+/*
+ * random reading, with the transaction as the IRQ handler would log it:
+ * host LOW and release, DHT22 response, 40 bits, final edge;
+ * edges are timestamped, then logged the same way as in the driver
+ */
+static void make_trace(struct trace_t* trace, int jitter_us, int drops,
+                       int duplicates)
+{
+    u64     t[2 * DHT22_EDGES];     /* absolute time of each edge, ns */
+    int     level[2 * DHT22_EDGES];
+    u8      data[5];
+    int     humidity = rand_range(0, 1000);
+    int     temperature = rand_range(-400, 800);
+    int     raw_temp = temperature < 0 ? 0x8000 | -temperature : temperature;
+    int     n = 0;
+    int     i;
+    u64     now = 0;
+    u64     prev;
+
+    data[0] = humidity >> 8;
+    data[1] = humidity & 0xFF;
+    data[2] = raw_temp >> 8;
+    data[3] = raw_temp & 0xFF;
+    data[4] = (data[0] + data[1] + data[2] + data[3]) & 0xFF;
+
+    trace->known       = 1;
+    trace->humidity    = humidity;
+    trace->temperature = temperature;
+
+#define EDGE(lvl, after_ns) do {                                \
+        now += (after_ns);                                      \
+        t[n] = now; level[n] = (lvl); ++n;                      \
+    } while (0)
+
+    EDGE(0, 14000);                             /* host pulls LOW */
+    EDGE(1, 1000000);                           /* host releases */
+    EDGE(0, rand_range(20000, 40000));          /* DHT22 response */
+    EDGE(1, rand_range(75000, 85000));
+    EDGE(0, rand_range(75000, 85000));
+    for (i = 0; i < DHT22_BITS; ++i) {
+        int bit = (data[i >> 3] >> (7 - (i & 7))) & 1;
+
+        EDGE(1, rand_range(48000, 55000));
+        EDGE(0, bit ? rand_range(68000, 75000) : rand_range(22000, 30000));
+    }
+    EDGE(1, rand_range(48000, 55000));          /* DHT22 releases */
+#undef EDGE
+
+    /* IRQ latency, edges stay in order */
+    for (i = 1; i < n && jitter_us > 0; ++i) {
+        u64 late = t[i] + rand_range(0, jitter_us * 1000);
+
+        t[i] = late > t[i - 1] ? late : t[i - 1] + 1;
+    }
+
+    /* lost interrupts, never the host's own edges */
+    for (i = 0; i < drops && n > 6; ++i) {
+        int k = rand_range(5, n - 2);
+
+        memmove(&t[k], &t[k + 1], (n - k - 1) * sizeof(t[0]));
+        memmove(&level[k], &level[k + 1], (n - k - 1) * sizeof(level[0]));
+        --n;
+    }
+
+    /* spurious interrupts, a few usec after a real edge, same level */
+    for (i = 0; i < duplicates && n < (int)SIZEOF(t) - 1; ++i) {
+        int k = rand_range(5, n - 2);
+
+        memmove(&t[k + 2], &t[k + 1], (n - k - 1) * sizeof(t[0]));
+        memmove(&level[k + 2], &level[k + 1], (n - k - 1) * sizeof(level[0]));
+        t[k + 1]     = t[k] + rand_range(1000, 5000);
+        level[k + 1] = level[k];
+        /* before the next one, which may be a duplicate of the same edge */
+        if (t[k + 1] >= t[k + 2])
+            t[k + 1] = (t[k] + t[k + 2]) / 2;
+        ++n;
+    }
+
+    /* what dht22_irq_handler() does on each of them */
+    prev = 0;
+    trace->count = 0;
+    for (i = 0; i < n; ++i) {
+        dht22_log_edge(trace->edges, trace->count, t[i] - prev, level[i]);
+        prev = t[i];
+        ++trace->count;
+    }
+    if (trace->count > DHT22_EDGES_MAX)
+        trace->count = DHT22_EDGES_MAX;
+}
+
+/*
+ * same as process_results(), including sign of the temperature
+ */
+static int decode(const struct trace_t* trace, int* humidity,
+                  int* temperature, struct dht22_decode_info* info)
+{
+    u8  data[5];
+    int ret = dht22_decode_edges(trace->edges, trace->count, data, info);
+
+    *humidity    = (data[0] << 8) | data[1];
+    *temperature = (data[2] << 8) | data[3];
+    if (data[2] & 0x80)
+        *temperature = -(*temperature & 0x7FFF);
+    return ret;
+}
+
+static enum result_t check(const struct trace_t* trace, int ret,
+                           int humidity, int temperature)
+{
+    if (0 == ret) {
+        if (trace->known && (humidity != trace->humidity ||
+                             temperature != trace->temperature))
+            return RES_WRONG;
+        return RES_OK;
+    }
+
+    /* a recorded frame known to be good must be decoded */
+    if (trace->known && trace->recorded)
+        return RES_FAILED;
+    return -EIO == ret ? RES_CRC : RES_INCOMPLETE;
+}
+
+/* "79.5" or "-3.2" to 795 or -32 */
+static int tenths(const char* s)
+{
+    double v = atof(s);
+
+    return (int)(v * 10 + (v < 0 ? -0.5 : 0.5));
+}
+
+static u64 now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}